@@ -0,0 +1,94 @@
+#pragma once
+#include "Match.hpp"
+#include <random>
+
+struct BotProfile {
+  // Chance that a purchase is an attacker rather than a wall.
+  float aggression = 0.7f;
+  // Chance that a decision portals one of its attackers into enemy territory.
+  float portalChance = 0.2f;
+  float decisionInterval = 0.5f;
+};
+
+// A scripted player for headless matches: every decision interval it either
+// portals an attacker next to the enemy reactor or buys an attacker or a wall
+// on a random tile of its own half.
+class ScriptedBot {
+private:
+  Player player;
+  BotProfile profile;
+  std::mt19937 rng;
+  float timer = 0.0f;
+
+public:
+  ScriptedBot(Player p, BotProfile prof, unsigned seed)
+      : player(p), profile(prof), rng(seed) {}
+
+  void Update(Match &match, float deltaTime) {
+    timer -= deltaTime;
+    if (timer > 0.0f)
+      return;
+    timer += profile.decisionInterval;
+
+    int halfWidth = static_cast<int>(match.GetMap().Width()) / 2;
+    int halfDepth = static_cast<int>(match.GetMap().Depth()) / 2;
+    std::uniform_int_distribution<int> column(-halfWidth, halfWidth);
+    std::uniform_int_distribution<int> row(1, halfDepth);
+    std::uniform_real_distribution<float> chance(0.0f, 1.0f);
+
+    if (chance(rng) < profile.portalChance && TryPortal(match)) {
+      return;
+    }
+
+    int gridZ = row(rng) * (player == Player::PLAYER1 ? -1 : 1);
+    Vector3 tileTop = {column(rng) * tileSize, 1.0f, gridZ * tileSize};
+    Vector3 spawnPos = match.SnapToGrid(tileTop);
+
+    if (chance(rng) < profile.aggression) {
+      match.Submit(SpawnAttacker{player, spawnPos});
+    } else {
+      match.Submit(SpawnWall{player, spawnPos});
+    }
+  }
+
+private:
+  bool TryPortal(Match &match) {
+    Scene &scene = match.GetScene();
+    Player enemy =
+        player == Player::PLAYER1 ? Player::PLAYER2 : Player::PLAYER1;
+    auto enemyReactor =
+        scene.ReadComponent<TransformET>(match.GetReactor(enemy));
+    if (!enemyReactor)
+      return false;
+
+    for (auto entity : scene.Query<AttackerET, PlayerET, TransformET>()) {
+      auto playerComp = scene.ReadComponent<PlayerET>(entity);
+      auto transform = scene.ReadComponent<TransformET>(entity);
+      if (!playerComp || !transform || playerComp->player != player)
+        continue;
+
+      // Only attackers still on the home half are worth moving.
+      bool isHome = player == Player::PLAYER1 ? transform->position.z < 0
+                                              : transform->position.z > 0;
+      if (!isHome)
+        continue;
+
+      std::vector<EntityId> selected =
+          match.SelectPortalEntities(player, transform->position);
+      if (selected.empty())
+        return false;
+
+      // Two rows in front of the enemy reactor, within a few columns of it.
+      std::uniform_int_distribution<int> column(-3, 3);
+      int reactorRow =
+          static_cast<int>(round(enemyReactor->position.z / tileSize));
+      int gridZ = reactorRow + (player == Player::PLAYER1 ? -2 : 2);
+      Vector3 destination = match.SnapToGrid(
+          {column(rng) * tileSize, 1.0f, gridZ * tileSize});
+
+      match.Submit(PortalMove{player, selected, destination});
+      return true;
+    }
+    return false;
+  }
+};
@@ -0,0 +1,29 @@
+#pragma once
+#include "ECS.hpp"
+#include "entity-components/Player.hpp"
+#include <raylib.h>
+#include <variant>
+#include <vector>
+
+// What a player can ask the match to do. Commands are plain data, so the
+// game, bots, network clients and replays all drive the match the same way;
+// the match validates them, charges for them and applies them in submission
+// order at the start of the next tick.
+struct SpawnAttacker {
+  Player owner;
+  Vector3 position;
+};
+
+struct SpawnWall {
+  Player owner;
+  Vector3 position;
+};
+
+// Moves the owner's entities to the destination tile.
+struct PortalMove {
+  Player owner;
+  std::vector<EntityId> entities;
+  Vector3 destination;
+};
+
+using Command = std::variant<SpawnAttacker, SpawnWall, PortalMove>;
@@ -0,0 +1,504 @@
+#pragma once
+#include "ECS.hpp"
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <raylib.h>
+#include <vector>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define MIH_X86_KERNELS 1
+#endif
+
+inline uint32_t TeamBit(Player player) {
+  return 1u << static_cast<uint32_t>(player);
+}
+
+// Candidate positions laid out as structure-of-arrays so the kernels can load
+// eight (AVX2) or four (SSE) candidates per instruction. Each candidate carries
+// a team bit; a kernel only considers candidates whose bit is in the query's
+// team mask, and a retired candidate has no bits so it never matches. Teams
+// fit in a byte, which keeps the bits a small share of what a scan reads.
+struct PositionBuffer {
+  std::vector<float> x;
+  std::vector<float> y;
+  std::vector<float> z;
+  std::vector<uint8_t> teamBits;
+  std::vector<EntityId> entities;
+
+  std::size_t Size() const { return entities.size(); }
+
+  void Clear() {
+    x.clear();
+    y.clear();
+    z.clear();
+    teamBits.clear();
+    entities.clear();
+  }
+
+  void Reserve(std::size_t count) {
+    x.reserve(count);
+    y.reserve(count);
+    z.reserve(count);
+    teamBits.reserve(count);
+    entities.reserve(count);
+  }
+
+  void Push(EntityId entity, Vector3 position, uint32_t bits) {
+    x.push_back(position.x);
+    y.push_back(position.y);
+    z.push_back(position.z);
+    teamBits.push_back(static_cast<uint8_t>(bits));
+    entities.push_back(entity);
+  }
+
+  void Retire(std::size_t index) { teamBits[index] = 0; }
+};
+
+namespace kernels {
+
+inline void SquaredDistancesScalar(const PositionBuffer &buffer,
+                                   Vector3 origin, std::size_t begin,
+                                   float *out) {
+  for (std::size_t i = begin; i < buffer.Size(); i++) {
+    float dx = buffer.x[i] - origin.x;
+    float dy = buffer.y[i] - origin.y;
+    float dz = buffer.z[i] - origin.z;
+    out[i] = dx * dx + dy * dy + dz * dz;
+  }
+}
+
+inline void NearestScalar(const PositionBuffer &buffer, Vector3 origin,
+                          uint32_t teamMask, std::size_t begin,
+                          std::size_t end, std::ptrdiff_t &best,
+                          float &bestDistanceSq) {
+  for (std::size_t i = begin; i < end; i++) {
+    if (!(buffer.teamBits[i] & teamMask))
+      continue;
+
+    float dx = buffer.x[i] - origin.x;
+    float dy = buffer.y[i] - origin.y;
+    float dz = buffer.z[i] - origin.z;
+    float distanceSq = dx * dx + dy * dy + dz * dz;
+    if (distanceSq < bestDistanceSq) {
+      bestDistanceSq = distanceSq;
+      best = static_cast<std::ptrdiff_t>(i);
+    }
+  }
+}
+
+inline void WithinRadiusScalar(const PositionBuffer &buffer, Vector3 origin,
+                               float radiusSq, uint32_t teamMask,
+                               std::size_t begin, uint8_t *out) {
+  for (std::size_t i = begin; i < buffer.Size(); i++) {
+    float dx = buffer.x[i] - origin.x;
+    float dy = buffer.y[i] - origin.y;
+    float dz = buffer.z[i] - origin.z;
+    out[i] = (buffer.teamBits[i] & teamMask) &&
+             dx * dx + dy * dy + dz * dz <= radiusSq;
+  }
+}
+
+inline void WithinSquareScalar(const PositionBuffer &buffer, Vector3 origin,
+                               float halfSize, uint32_t teamMask,
+                               std::size_t begin, uint8_t *out) {
+  for (std::size_t i = begin; i < buffer.Size(); i++) {
+    out[i] = (buffer.teamBits[i] & teamMask) &&
+             std::fabs(buffer.x[i] - origin.x) < halfSize &&
+             std::fabs(buffer.z[i] - origin.z) < halfSize;
+  }
+}
+
+// The SIMD nearest kernels only keep a running minimum per lane, over blocks
+// of NEAREST_BLOCK candidates. A block whose minimum beats the best so far
+// is scanned again in order to find which candidate it was, so the lowest
+// index among equal distances wins as in the scalar loop. Blocks that
+// improve on the best get rarer as the scan goes on.
+constexpr std::size_t NEAREST_BLOCK = 64;
+
+#ifdef MIH_X86_KERNELS
+
+// For every movemask of up to eight lanes, one byte per lane: 1 where the
+// lane's bit is set. Lets the mask kernels store a vector's results with one
+// write instead of one per lane.
+struct LaneByteTable {
+  uint64_t bytes[256] = {};
+
+  constexpr LaneByteTable() {
+    for (int lanes = 0; lanes < 256; lanes++) {
+      for (int lane = 0; lane < 8; lane++) {
+        if ((lanes >> lane) & 1) {
+          bytes[lanes] |= uint64_t(1) << (8 * lane);
+        }
+      }
+    }
+  }
+};
+inline constexpr LaneByteTable LANE_BYTES;
+
+// The team bits of four (SSE) or eight (AVX2) candidates, one per lane.
+__attribute__((target("sse2"))) inline __m128i
+LoadTeamBitsSSE(const uint8_t *bits) {
+  int32_t packed;
+  std::memcpy(&packed, bits, 4);
+  __m128i zero = _mm_setzero_si128();
+  return _mm_unpacklo_epi16(
+      _mm_unpacklo_epi8(_mm_cvtsi32_si128(packed), zero), zero);
+}
+
+__attribute__((target("avx2"))) inline __m256i
+LoadTeamBitsAVX2(const uint8_t *bits) {
+  return _mm256_cvtepu8_epi32(
+      _mm_loadl_epi64(reinterpret_cast<const __m128i *>(bits)));
+}
+
+__attribute__((target("sse2"))) inline void
+SquaredDistancesSSE(const PositionBuffer &buffer, Vector3 origin, float *out) {
+  std::size_t count = buffer.Size(), i = 0;
+  __m128 ox = _mm_set1_ps(origin.x);
+  __m128 oy = _mm_set1_ps(origin.y);
+  __m128 oz = _mm_set1_ps(origin.z);
+
+  for (; i + 4 <= count; i += 4) {
+    __m128 dx = _mm_sub_ps(_mm_loadu_ps(&buffer.x[i]), ox);
+    __m128 dy = _mm_sub_ps(_mm_loadu_ps(&buffer.y[i]), oy);
+    __m128 dz = _mm_sub_ps(_mm_loadu_ps(&buffer.z[i]), oz);
+    __m128 distanceSq = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx),
+                                              _mm_mul_ps(dy, dy)),
+                                   _mm_mul_ps(dz, dz));
+    _mm_storeu_ps(&out[i], distanceSq);
+  }
+  SquaredDistancesScalar(buffer, origin, i, out);
+}
+
+__attribute__((target("sse2"))) inline std::ptrdiff_t
+NearestSSE(const PositionBuffer &buffer, Vector3 origin, uint32_t teamMask,
+           float *outDistanceSq) {
+  std::size_t count = buffer.Size(), i = 0;
+  __m128 ox = _mm_set1_ps(origin.x);
+  __m128 oy = _mm_set1_ps(origin.y);
+  __m128 oz = _mm_set1_ps(origin.z);
+  __m128i mask = _mm_set1_epi32(static_cast<int32_t>(teamMask));
+  __m128i zero = _mm_setzero_si128();
+  __m128 inf = _mm_set1_ps(INFINITY);
+
+  std::ptrdiff_t best = -1;
+  float bestDistanceSq = INFINITY;
+  for (; i + NEAREST_BLOCK <= count; i += NEAREST_BLOCK) {
+    __m128 blockMin = inf;
+    for (std::size_t at = i; at < i + NEAREST_BLOCK; at += 4) {
+      __m128 dx = _mm_sub_ps(_mm_loadu_ps(&buffer.x[at]), ox);
+      __m128 dy = _mm_sub_ps(_mm_loadu_ps(&buffer.y[at]), oy);
+      __m128 dz = _mm_sub_ps(_mm_loadu_ps(&buffer.z[at]), oz);
+      __m128 distanceSq = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx),
+                                                _mm_mul_ps(dy, dy)),
+                                     _mm_mul_ps(dz, dz));
+
+      __m128i bits = LoadTeamBitsSSE(&buffer.teamBits[at]);
+      __m128 excluded =
+          _mm_castsi128_ps(_mm_cmpeq_epi32(_mm_and_si128(bits, mask), zero));
+      distanceSq = _mm_or_ps(_mm_and_ps(excluded, inf),
+                             _mm_andnot_ps(excluded, distanceSq));
+      blockMin = _mm_min_ps(distanceSq, blockMin);
+    }
+    __m128 improves = _mm_cmplt_ps(blockMin, _mm_set1_ps(bestDistanceSq));
+    if (_mm_movemask_ps(improves)) {
+      NearestScalar(buffer, origin, teamMask, i, i + NEAREST_BLOCK, best,
+                    bestDistanceSq);
+    }
+  }
+  NearestScalar(buffer, origin, teamMask, i, count, best, bestDistanceSq);
+
+  if (outDistanceSq)
+    *outDistanceSq = bestDistanceSq;
+  return best;
+}
+
+__attribute__((target("sse2"))) inline void
+WithinRadiusSSE(const PositionBuffer &buffer, Vector3 origin, float radiusSq,
+                uint32_t teamMask, uint8_t *out) {
+  std::size_t count = buffer.Size(), i = 0;
+  __m128 ox = _mm_set1_ps(origin.x);
+  __m128 oy = _mm_set1_ps(origin.y);
+  __m128 oz = _mm_set1_ps(origin.z);
+  __m128 radius = _mm_set1_ps(radiusSq);
+  __m128i mask = _mm_set1_epi32(static_cast<int32_t>(teamMask));
+  __m128i zero = _mm_setzero_si128();
+
+  for (; i + 4 <= count; i += 4) {
+    __m128 dx = _mm_sub_ps(_mm_loadu_ps(&buffer.x[i]), ox);
+    __m128 dy = _mm_sub_ps(_mm_loadu_ps(&buffer.y[i]), oy);
+    __m128 dz = _mm_sub_ps(_mm_loadu_ps(&buffer.z[i]), oz);
+    __m128 distanceSq = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx),
+                                              _mm_mul_ps(dy, dy)),
+                                   _mm_mul_ps(dz, dz));
+
+    __m128i bits = LoadTeamBitsSSE(&buffer.teamBits[i]);
+    __m128 excluded =
+        _mm_castsi128_ps(_mm_cmpeq_epi32(_mm_and_si128(bits, mask), zero));
+    __m128 inside =
+        _mm_andnot_ps(excluded, _mm_cmple_ps(distanceSq, radius));
+
+    int lanes = _mm_movemask_ps(inside);
+    std::memcpy(&out[i], &LANE_BYTES.bytes[lanes], 4);
+  }
+  WithinRadiusScalar(buffer, origin, radiusSq, teamMask, i, out);
+}
+
+__attribute__((target("sse2"))) inline void
+WithinSquareSSE(const PositionBuffer &buffer, Vector3 origin, float halfSize,
+                uint32_t teamMask, uint8_t *out) {
+  std::size_t count = buffer.Size(), i = 0;
+  __m128 ox = _mm_set1_ps(origin.x);
+  __m128 oz = _mm_set1_ps(origin.z);
+  __m128 half = _mm_set1_ps(halfSize);
+  __m128 sign = _mm_set1_ps(-0.0f);
+  __m128i mask = _mm_set1_epi32(static_cast<int32_t>(teamMask));
+  __m128i zero = _mm_setzero_si128();
+
+  for (; i + 4 <= count; i += 4) {
+    __m128 dx = _mm_andnot_ps(sign, _mm_sub_ps(_mm_loadu_ps(&buffer.x[i]), ox));
+    __m128 dz = _mm_andnot_ps(sign, _mm_sub_ps(_mm_loadu_ps(&buffer.z[i]), oz));
+
+    __m128i bits = LoadTeamBitsSSE(&buffer.teamBits[i]);
+    __m128 excluded =
+        _mm_castsi128_ps(_mm_cmpeq_epi32(_mm_and_si128(bits, mask), zero));
+    __m128 inside = _mm_andnot_ps(
+        excluded, _mm_and_ps(_mm_cmplt_ps(dx, half), _mm_cmplt_ps(dz, half)));
+
+    int lanes = _mm_movemask_ps(inside);
+    std::memcpy(&out[i], &LANE_BYTES.bytes[lanes], 4);
+  }
+  WithinSquareScalar(buffer, origin, halfSize, teamMask, i, out);
+}
+
+__attribute__((target("avx2"))) inline void
+SquaredDistancesAVX2(const PositionBuffer &buffer, Vector3 origin,
+                     float *out) {
+  std::size_t count = buffer.Size(), i = 0;
+  __m256 ox = _mm256_set1_ps(origin.x);
+  __m256 oy = _mm256_set1_ps(origin.y);
+  __m256 oz = _mm256_set1_ps(origin.z);
+
+  for (; i + 8 <= count; i += 8) {
+    __m256 dx = _mm256_sub_ps(_mm256_loadu_ps(&buffer.x[i]), ox);
+    __m256 dy = _mm256_sub_ps(_mm256_loadu_ps(&buffer.y[i]), oy);
+    __m256 dz = _mm256_sub_ps(_mm256_loadu_ps(&buffer.z[i]), oz);
+    __m256 distanceSq = _mm256_add_ps(
+        _mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dy, dy)),
+        _mm256_mul_ps(dz, dz));
+    _mm256_storeu_ps(&out[i], distanceSq);
+  }
+  SquaredDistancesScalar(buffer, origin, i, out);
+}
+
+__attribute__((target("avx2"))) inline std::ptrdiff_t
+NearestAVX2(const PositionBuffer &buffer, Vector3 origin, uint32_t teamMask,
+            float *outDistanceSq) {
+  std::size_t count = buffer.Size(), i = 0;
+  __m256 ox = _mm256_set1_ps(origin.x);
+  __m256 oy = _mm256_set1_ps(origin.y);
+  __m256 oz = _mm256_set1_ps(origin.z);
+  __m256i mask = _mm256_set1_epi32(static_cast<int32_t>(teamMask));
+  __m256i zero = _mm256_setzero_si256();
+  __m256 inf = _mm256_set1_ps(INFINITY);
+
+  std::ptrdiff_t best = -1;
+  float bestDistanceSq = INFINITY;
+  for (; i + NEAREST_BLOCK <= count; i += NEAREST_BLOCK) {
+    // Two independent minimums hide the latency of the min chain.
+    __m256 blockMin[2] = {inf, inf};
+    for (std::size_t at = i; at < i + NEAREST_BLOCK; at += 16) {
+      for (int half = 0; half < 2; half++) {
+        std::size_t lane = at + half * 8;
+        // Origin minus candidate, which squares the same, lets the loads
+        // fold into the subtractions.
+        __m256 dx = _mm256_sub_ps(ox, _mm256_loadu_ps(&buffer.x[lane]));
+        __m256 dy = _mm256_sub_ps(oy, _mm256_loadu_ps(&buffer.y[lane]));
+        __m256 dz = _mm256_sub_ps(oz, _mm256_loadu_ps(&buffer.z[lane]));
+        __m256 distanceSq = _mm256_add_ps(
+            _mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dy, dy)),
+            _mm256_mul_ps(dz, dz));
+
+        // Excluded lanes become NaN, and min returns its second operand
+        // when the first is NaN, so they never lower the minimum.
+        __m256i bits = LoadTeamBitsAVX2(&buffer.teamBits[lane]);
+        __m256 excluded = _mm256_castsi256_ps(
+            _mm256_cmpeq_epi32(_mm256_and_si256(bits, mask), zero));
+        blockMin[half] =
+            _mm256_min_ps(_mm256_or_ps(distanceSq, excluded), blockMin[half]);
+      }
+    }
+    __m256 improves =
+        _mm256_cmp_ps(_mm256_min_ps(blockMin[0], blockMin[1]),
+                      _mm256_set1_ps(bestDistanceSq), _CMP_LT_OQ);
+    if (_mm256_movemask_ps(improves)) {
+      NearestScalar(buffer, origin, teamMask, i, i + NEAREST_BLOCK, best,
+                    bestDistanceSq);
+    }
+  }
+  NearestScalar(buffer, origin, teamMask, i, count, best, bestDistanceSq);
+
+  if (outDistanceSq)
+    *outDistanceSq = bestDistanceSq;
+  return best;
+}
+
+__attribute__((target("avx2"))) inline void
+WithinRadiusAVX2(const PositionBuffer &buffer, Vector3 origin, float radiusSq,
+                 uint32_t teamMask, uint8_t *out) {
+  std::size_t count = buffer.Size(), i = 0;
+  __m256 ox = _mm256_set1_ps(origin.x);
+  __m256 oy = _mm256_set1_ps(origin.y);
+  __m256 oz = _mm256_set1_ps(origin.z);
+  __m256 radius = _mm256_set1_ps(radiusSq);
+  __m256i mask = _mm256_set1_epi32(static_cast<int32_t>(teamMask));
+  __m256i zero = _mm256_setzero_si256();
+
+  for (; i + 8 <= count; i += 8) {
+    __m256 dx = _mm256_sub_ps(_mm256_loadu_ps(&buffer.x[i]), ox);
+    __m256 dy = _mm256_sub_ps(_mm256_loadu_ps(&buffer.y[i]), oy);
+    __m256 dz = _mm256_sub_ps(_mm256_loadu_ps(&buffer.z[i]), oz);
+    __m256 distanceSq = _mm256_add_ps(
+        _mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dy, dy)),
+        _mm256_mul_ps(dz, dz));
+
+    __m256i bits = LoadTeamBitsAVX2(&buffer.teamBits[i]);
+    __m256 excluded = _mm256_castsi256_ps(
+        _mm256_cmpeq_epi32(_mm256_and_si256(bits, mask), zero));
+    __m256 inside = _mm256_andnot_ps(
+        excluded, _mm256_cmp_ps(distanceSq, radius, _CMP_LE_OQ));
+
+    int lanes = _mm256_movemask_ps(inside);
+    std::memcpy(&out[i], &LANE_BYTES.bytes[lanes], 8);
+  }
+  WithinRadiusScalar(buffer, origin, radiusSq, teamMask, i, out);
+}
+
+__attribute__((target("avx2"))) inline void
+WithinSquareAVX2(const PositionBuffer &buffer, Vector3 origin, float halfSize,
+                 uint32_t teamMask, uint8_t *out) {
+  std::size_t count = buffer.Size(), i = 0;
+  __m256 ox = _mm256_set1_ps(origin.x);
+  __m256 oz = _mm256_set1_ps(origin.z);
+  __m256 half = _mm256_set1_ps(halfSize);
+  __m256 sign = _mm256_set1_ps(-0.0f);
+  __m256i mask = _mm256_set1_epi32(static_cast<int32_t>(teamMask));
+  __m256i zero = _mm256_setzero_si256();
+
+  for (; i + 8 <= count; i += 8) {
+    __m256 dx = _mm256_andnot_ps(
+        sign, _mm256_sub_ps(_mm256_loadu_ps(&buffer.x[i]), ox));
+    __m256 dz = _mm256_andnot_ps(
+        sign, _mm256_sub_ps(_mm256_loadu_ps(&buffer.z[i]), oz));
+
+    __m256i bits = LoadTeamBitsAVX2(&buffer.teamBits[i]);
+    __m256 excluded = _mm256_castsi256_ps(
+        _mm256_cmpeq_epi32(_mm256_and_si256(bits, mask), zero));
+    __m256 inside = _mm256_andnot_ps(
+        excluded, _mm256_and_ps(_mm256_cmp_ps(dx, half, _CMP_LT_OQ),
+                                _mm256_cmp_ps(dz, half, _CMP_LT_OQ)));
+
+    int lanes = _mm256_movemask_ps(inside);
+    std::memcpy(&out[i], &LANE_BYTES.bytes[lanes], 8);
+  }
+  WithinSquareScalar(buffer, origin, halfSize, teamMask, i, out);
+}
+
+#endif
+
+inline void SquaredDistancesFallback(const PositionBuffer &buffer,
+                                     Vector3 origin, float *out) {
+  SquaredDistancesScalar(buffer, origin, 0, out);
+}
+
+inline std::ptrdiff_t NearestFallback(const PositionBuffer &buffer,
+                                      Vector3 origin, uint32_t teamMask,
+                                      float *outDistanceSq) {
+  std::ptrdiff_t best = -1;
+  float bestDistanceSq = INFINITY;
+  NearestScalar(buffer, origin, teamMask, 0, buffer.Size(), best,
+                bestDistanceSq);
+  if (outDistanceSq)
+    *outDistanceSq = bestDistanceSq;
+  return best;
+}
+
+inline void WithinRadiusFallback(const PositionBuffer &buffer, Vector3 origin,
+                                 float radiusSq, uint32_t teamMask,
+                                 uint8_t *out) {
+  WithinRadiusScalar(buffer, origin, radiusSq, teamMask, 0, out);
+}
+
+inline void WithinSquareFallback(const PositionBuffer &buffer, Vector3 origin,
+                                 float halfSize, uint32_t teamMask,
+                                 uint8_t *out) {
+  WithinSquareScalar(buffer, origin, halfSize, teamMask, 0, out);
+}
+
+struct DistanceKernelTable {
+  const char *name;
+  void (*squaredDistances)(const PositionBuffer &, Vector3, float *);
+  std::ptrdiff_t (*nearest)(const PositionBuffer &, Vector3, uint32_t,
+                            float *);
+  void (*withinRadius)(const PositionBuffer &, Vector3, float, uint32_t,
+                       uint8_t *);
+  void (*withinSquare)(const PositionBuffer &, Vector3, float, uint32_t,
+                       uint8_t *);
+};
+
+inline DistanceKernelTable SelectDistanceKernels() {
+#ifdef MIH_X86_KERNELS
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) {
+    return {"avx2", SquaredDistancesAVX2, NearestAVX2, WithinRadiusAVX2,
+            WithinSquareAVX2};
+  }
+  if (__builtin_cpu_supports("sse2")) {
+    return {"sse2", SquaredDistancesSSE, NearestSSE, WithinRadiusSSE,
+            WithinSquareSSE};
+  }
+#endif
+  return {"scalar", SquaredDistancesFallback, NearestFallback,
+          WithinRadiusFallback, WithinSquareFallback};
+}
+
+inline const DistanceKernelTable &ActiveDistanceKernels() {
+  static const DistanceKernelTable table = SelectDistanceKernels();
+  return table;
+}
+
+} // namespace kernels
+
+// Writes the squared distance from origin to every candidate into out, which
+// must hold buffer.Size() floats.
+inline void SquaredDistances(const PositionBuffer &buffer, Vector3 origin,
+                             float *out) {
+  kernels::ActiveDistanceKernels().squaredDistances(buffer, origin, out);
+}
+
+// Index of the closest candidate whose team bit is in teamMask, or -1.
+inline std::ptrdiff_t NearestIndex(const PositionBuffer &buffer,
+                                   Vector3 origin, uint32_t teamMask,
+                                   float *outDistanceSq = nullptr) {
+  return kernels::ActiveDistanceKernels().nearest(buffer, origin, teamMask,
+                                                  outDistanceSq);
+}
+
+// Sets out[i] to 1 for every candidate in teamMask within radius of origin.
+inline void WithinRadius(const PositionBuffer &buffer, Vector3 origin,
+                         float radius, uint32_t teamMask, uint8_t *out) {
+  kernels::ActiveDistanceKernels().withinRadius(buffer, origin,
+                                                radius * radius, teamMask, out);
+}
+
+// Sets out[i] to 1 for every candidate in teamMask strictly less than
+// halfSize from origin along both x and z: the square of side 2 * halfSize
+// around it in the ground plane.
+inline void WithinSquare(const PositionBuffer &buffer, Vector3 origin,
+                         float halfSize, uint32_t teamMask, uint8_t *out) {
+  kernels::ActiveDistanceKernels().withinSquare(buffer, origin, halfSize,
+                                                teamMask, out);
+}
@@ -1,28 +1,290 @@
 #pragma once
 #include "EntityComponent.hpp"
+#include "Telemetry.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <map>
 #include <memory>
+#include <memory_resource>
+#include <mutex>
+#include <tuple>
 #include <typeindex>
 #include <unordered_map>
+#include <unordered_set>
 #include <vector>
 
 using EntityId = std::size_t;
 
+// A component and the scene change tick it was last written at.
+struct ComponentSlot {
+  std::shared_ptr<void> component;
+  uint32_t changed = 0;
+};
+
+// Both tables draw their nodes from the scene's pool, so creating an entity
+// costs no heap allocation of its own once the pool has grown.
+using ComponentTable = std::pmr::unordered_map<std::type_index, ComponentSlot>;
+using EntityTable = std::pmr::unordered_map<EntityId, ComponentTable>;
+
+// Entities that have every component of the signature, kept current by the
+// scene as components are assigned and entities removed. matches is in
+// ascending id order, the order entities were created in. Removals only drop
+// the entity from members; matches is compacted on the next read.
+struct PersistentQuery {
+  std::vector<std::type_index> signature;
+  std::vector<EntityId> matches;
+  std::unordered_set<EntityId> members;
+  std::size_t stale = 0;
+
+  void Add(EntityId entity) {
+    Compact();
+    if (!members.insert(entity).second)
+      return;
+    if (matches.empty() || matches.back() < entity) {
+      matches.push_back(entity);
+    } else {
+      matches.insert(
+          std::lower_bound(matches.begin(), matches.end(), entity), entity);
+    }
+  }
+
+  void Remove(EntityId entity) { stale += members.erase(entity); }
+
+  void Compact() {
+    if (stale == 0)
+      return;
+    matches.erase(std::remove_if(matches.begin(), matches.end(),
+                                 [this](EntityId entity) {
+                                   return members.count(entity) == 0;
+                                 }),
+                  matches.end());
+    stale = 0;
+  }
+};
+
+// Where the stamps of one component type went, in the order they were
+// made: an entry per entity and tick the component was first written at.
+// A type's log starts the first time someone asks for its changes and is
+// complete from horizon on; older entries are trimmed once nobody asked for
+// them in a while.
+struct ChangeLog {
+  struct Entry {
+    uint32_t tick;
+    EntityId entity;
+  };
+
+  static constexpr int TRIM_CALLS = 64;
+  static constexpr std::size_t MIN_CAPACITY = 4096;
+
+  bool tracked = false;
+  uint32_t horizon = 0;
+  std::vector<Entry> entries;
+  // The oldest tick asked for since the last trim, and the calls since.
+  uint32_t oldestAsked = UINT32_MAX;
+  int calls = 0;
+
+  // Entries from since on.
+  std::vector<Entry>::const_iterator From(uint32_t since) const {
+    return std::lower_bound(
+        entries.begin(), entries.end(), since,
+        [](const Entry &entry, uint32_t tick) { return entry.tick < tick; });
+  }
+
+  // Appends a stamp. Past a few entries per live component the readers
+  // have stopped asking, so the log starts over at the next tick.
+  void Append(uint32_t tick, EntityId entity, std::size_t live) {
+    if (entries.size() >= std::max(MIN_CAPACITY, 4 * live)) {
+      entries.clear();
+      horizon = tick + 1;
+    }
+    entries.push_back({tick, entity});
+  }
+
+  // Every TRIM_CALLS calls, drops what none of them asked for.
+  void Asked(uint32_t since) {
+    oldestAsked = std::min(oldestAsked, since);
+    if (++calls < TRIM_CALLS)
+      return;
+    auto first = From(oldestAsked);
+    if (first != entries.begin()) {
+      entries.erase(entries.begin(), first);
+      horizon = oldestAsked;
+    }
+    oldestAsked = UINT32_MAX;
+    calls = 0;
+  }
+};
+
 class Scene {
 private:
   EntityId nextEntityId = 0;
-  std::unordered_map<EntityId,
-                     std::unordered_map<std::type_index, std::shared_ptr<void>>>
-      components;
+  uint32_t changeTick = 1;
+  // Counters and the pool are declared before the tables so they outlive
+  // every allocation they track. The pool takes memory from the heap in
+  // growing blocks and keeps the nodes of removed entities for new ones, so
+  // tableAllocations counts blocks, not entities.
+  AllocationCounter tableAllocations;
+  CountingResource tableHeap{&tableAllocations};
+  std::pmr::unsynchronized_pool_resource tablePool{&tableHeap};
+  std::unordered_map<std::type_index, std::unique_ptr<MemoryEntry>>
+      componentMemory;
+  std::unordered_map<std::type_index, std::unique_ptr<ChangeLog>> changeLogs;
+  EntityTable components;
+  // Queries by their sorted signature, so Query<A, B> and Query<B, A> share
+  // one, and by the tuple of types they were asked for with, which spares
+  // sorting the signature on every call.
+  std::map<std::vector<std::type_index>, std::unique_ptr<PersistentQuery>>
+      persistentQueries;
+  std::unordered_map<std::type_index, PersistentQuery *> queriesByTypes;
+  std::unordered_map<std::type_index, std::vector<PersistentQuery *>>
+      queriesByComponent;
+  std::mutex queryMutex;
+
+  template <typename T> MemoryEntry &MemoryFor() {
+    auto &entry = componentMemory[std::type_index(typeid(T))];
+    if (!entry) {
+      entry = std::make_unique<MemoryEntry>();
+      entry->name = ReadableTypeName(typeid(T));
+      entry->elementBytes = sizeof(T);
+      changeLogs[std::type_index(typeid(T))] = std::make_unique<ChangeLog>();
+    }
+    return *entry;
+  }
+
+  // Sets the slot's change tick, logging the first stamp of each tick for
+  // types whose changes are asked for.
+  void Stamp(ComponentSlot &slot, std::type_index type, EntityId entity) {
+    if (slot.changed == changeTick)
+      return;
+    slot.changed = changeTick;
+    auto log = changeLogs.find(type);
+    if (log != changeLogs.end() && log->second->tracked) {
+      std::size_t live = componentMemory.at(type)->count;
+      log->second->Append(changeTick, entity, live);
+    }
+  }
+
+  ComponentTable &TableFor(EntityId entity) {
+    auto it = components.find(entity);
+    if (it == components.end()) {
+      it = components.try_emplace(entity).first;
+    }
+    return it->second;
+  }
+
+  void Attach(EntityId entity, std::type_index type,
+              std::shared_ptr<void> component, MemoryEntry &memory) {
+    ComponentTable &table = TableFor(entity);
+    auto &slot = table[type];
+    bool isNew = !slot.component;
+    slot.component = std::move(component);
+    Stamp(slot, type, entity);
+    if (!isNew)
+      return;
+
+    memory.count++;
+    auto interested = queriesByComponent.find(type);
+    if (interested == queriesByComponent.end())
+      return;
+    for (PersistentQuery *query : interested->second) {
+      if (Matches(table, *query)) {
+        query->Add(entity);
+      }
+    }
+  }
+
+  static bool Matches(const ComponentTable &table,
+                      const PersistentQuery &query) {
+    for (const auto &type : query.signature) {
+      if (table.find(type) == table.end())
+        return false;
+    }
+    return true;
+  }
+
+  // The query for signature, built with one scan of the scene the first
+  // time it is asked for.
+  PersistentQuery &QueryFor(std::vector<std::type_index> signature) {
+    std::sort(signature.begin(), signature.end());
+    signature.erase(std::unique(signature.begin(), signature.end()),
+                    signature.end());
+    auto &query = persistentQueries[signature];
+    if (query)
+      return *query;
+
+    query = std::make_unique<PersistentQuery>();
+    query->signature = std::move(signature);
+    for (const auto &type : query->signature) {
+      queriesByComponent[type].push_back(query.get());
+    }
+    for (auto entity : entities) {
+      auto entityIt = components.find(entity);
+      if (entityIt != components.end() && Matches(entityIt->second, *query)) {
+        query->Add(entity);
+      }
+    }
+    return *query;
+  }
+
+  // Uncounts the entity's components and drops it from the queries that
+  // track any of them.
+  void Detach(EntityId entity, const ComponentTable &table) {
+    for (const auto &[type, slot] : table) {
+      componentMemory[type]->count--;
+      auto interested = queriesByComponent.find(type);
+      if (interested == queriesByComponent.end())
+        continue;
+      for (PersistentQuery *query : interested->second) {
+        query->Remove(entity);
+      }
+    }
+  }
 
 public:
   std::vector<EntityId> entities;
+
+  Scene() : components(&tablePool) {}
+
+  // The tables allocate from this scene's pool.
+  Scene(const Scene &) = delete;
+  Scene &operator=(const Scene &) = delete;
+
   EntityId NewEntity() {
     EntityId id = nextEntityId++;
     entities.push_back(id);
     return id;
   }
 
-  template <typename T> T *GetComponent(EntityId entity) {
+  // Reserves room for the whole batch up front so a wave spawn grows the
+  // entity list and entity table once instead of once per entity. Each new
+  // entity's component table is sized for componentsPerEntity components;
+  // all of it comes from the pool.
+  std::vector<EntityId> NewEntities(std::size_t count,
+                                    std::size_t componentsPerEntity = 0) {
+    std::vector<EntityId> batch;
+    batch.reserve(count);
+    if (entities.capacity() < entities.size() + count) {
+      entities.reserve(
+          std::max(entities.size() + count, entities.capacity() * 2));
+    }
+    if (components.bucket_count() * components.max_load_factor() <
+        components.size() + count) {
+      components.reserve(
+          std::max(components.size() + count, components.size() * 2));
+    }
+
+    for (std::size_t i = 0; i < count; i++) {
+      EntityId id = nextEntityId++;
+      entities.push_back(id);
+      batch.push_back(id);
+      if (componentsPerEntity > 0) {
+        TableFor(id).reserve(componentsPerEntity);
+      }
+    }
+    return batch;
+  }
+
+  template <typename T> const ComponentSlot *SlotFor(EntityId entity) const {
     auto entityIt = components.find(entity);
     if (entityIt == components.end())
       return nullptr;
@@ -31,19 +293,143 @@ public:
     if (componentIt == entityIt->second.end())
       return nullptr;
 
-    return static_cast<T *>(componentIt->second.get());
+    return &componentIt->second;
+  }
+
+  // Mutable access: the component counts as changed at the current change
+  // tick. Use ReadComponent when only reading.
+  template <typename T> T *GetComponent(EntityId entity) {
+    auto slot = const_cast<ComponentSlot *>(SlotFor<T>(entity));
+    if (!slot)
+      return nullptr;
+    Stamp(*slot, std::type_index(typeid(T)), entity);
+    return static_cast<T *>(slot->component.get());
+  }
+
+  template <typename T> const T *ReadComponent(EntityId entity) const {
+    auto slot = SlotFor<T>(entity);
+    return slot ? static_cast<const T *>(slot->component.get()) : nullptr;
+  }
+
+  // For changes made through a pointer obtained earlier.
+  template <typename T> void MarkChanged(EntityId entity) {
+    auto slot = const_cast<ComponentSlot *>(SlotFor<T>(entity));
+    if (slot) {
+      Stamp(*slot, std::type_index(typeid(T)), entity);
+    }
+  }
+
+  // Change ticks only ever grow. A consumer of changes remembers the tick
+  // AdvanceChangeTick returned when it last ran and asks for everything
+  // changed since; whatever is written after that call is stamped with the
+  // new tick, so nothing is missed or seen twice.
+  uint32_t GetChangeTick() const { return changeTick; }
+  uint32_t AdvanceChangeTick() { return ++changeTick; }
+
+  template <typename T>
+  bool ChangedSince(EntityId entity, uint32_t since) const {
+    auto slot = SlotFor<T>(entity);
+    return slot && slot->changed >= since;
   }
 
   template <typename T, typename... Args>
   void AssignEntity(EntityId entity, Args &&...args) {
-    auto component = std::make_shared<T>(std::forward<Args>(args)...);
-    components[entity][std::type_index(typeid(T))] = component;
+    MemoryEntry &memory = MemoryFor<T>();
+    auto component = std::allocate_shared<T>(
+        CountingAllocator<T>(&memory.allocations), std::forward<Args>(args)...);
+    Attach(entity, std::type_index(typeid(T)), std::move(component), memory);
+  }
+
+  // Constructs every component of the batch in one contiguous block; each
+  // entity holds an aliasing pointer into it. The block is freed only when
+  // the last of them is removed: until then the components of the removed
+  // ones stay allocated, and the type's liveBytes in the memory report
+  // includes them while its count does not.
+  template <typename T>
+  void AssignBatch(const std::vector<EntityId> &batch, std::vector<T> values) {
+    using Block = std::vector<T, CountingAllocator<T>>;
+    MemoryEntry &memory = MemoryFor<T>();
+    CountingAllocator<T> allocator(&memory.allocations);
+    auto block = std::allocate_shared<Block>(
+        allocator, std::make_move_iterator(values.begin()),
+        std::make_move_iterator(values.end()), allocator);
+
+    std::type_index type(typeid(T));
+    for (std::size_t i = 0; i < batch.size(); i++) {
+      Attach(batch[i], type, std::shared_ptr<void>(block, &(*block)[i]),
+             memory);
+    }
+  }
+
+  template <typename T>
+  void AssignBatch(const std::vector<EntityId> &batch, const T &value) {
+    AssignBatch<T>(batch, std::vector<T>(batch.size(), value));
+  }
+
+  // Entities with all of Ts, in creation order. The first call for a
+  // combination scans the scene once; after that the result is maintained as
+  // components are assigned and entities removed, so a read costs
+  // O(matches). The order of Ts does not matter: every ordering shares one
+  // result. Removing entities while iterating the result is safe; assigning
+  // components that complete a match is not. Concurrent calls are safe as
+  // long as nothing changes the scene's structure meanwhile.
+  template <typename... Ts> const std::vector<EntityId> &Query() {
+    return PersistentQueryFor<Ts...>().matches;
+  }
+
+  template <typename... Ts> PersistentQuery &PersistentQueryFor() {
+    std::lock_guard<std::mutex> lock(queryMutex);
+    auto &query = queriesByTypes[std::type_index(typeid(std::tuple<Ts...>))];
+    if (!query) {
+      query = &QueryFor({std::type_index(typeid(Ts))...});
+    }
+    query->Compact();
+    return *query;
+  }
+
+  // Calls visit, in creation order, for every entity of Query<T, Ts...>()
+  // whose T changed since the given tick. The first call for a T scans the
+  // query and starts logging T's stamps; after that a consumer that asks
+  // every tick or so only reads the stamps made since it last asked. Like a
+  // first Query, that first call must not overlap writes to the scene.
+  template <typename T, typename... Ts, typename Visit>
+  void QueryChanged(uint32_t since, Visit &&visit) {
+    PersistentQuery &query = PersistentQueryFor<T, Ts...>();
+    auto logIt = changeLogs.find(std::type_index(typeid(T)));
+    ChangeLog *log = logIt == changeLogs.end() ? nullptr : logIt->second.get();
+    if (!log || !log->tracked || since < log->horizon) {
+      if (log && !log->tracked) {
+        log->tracked = true;
+        log->horizon = changeTick + 1;
+      }
+      for (auto entity : query.matches) {
+        if (ChangedSince<T>(entity, since)) {
+          visit(entity);
+        }
+      }
+      return;
+    }
+
+    // An entity stamped on several ticks is only taken at its latest.
+    std::vector<EntityId> changed;
+    for (auto it = log->From(since); it != log->entries.end(); ++it) {
+      auto slot = SlotFor<T>(it->entity);
+      if (slot && slot->changed == it->tick &&
+          query.members.count(it->entity)) {
+        changed.push_back(it->entity);
+      }
+    }
+    log->Asked(since);
+    std::sort(changed.begin(), changed.end());
+    for (auto entity : changed) {
+      visit(entity);
+    }
   }
 
   template <typename T> std::vector<EntityId> GetEntitiesWithComponent() {
     std::vector<EntityId> result;
     for (const auto &entity : entities) {
-      if (GetComponent<T>(entity) != nullptr) {
+      if (ReadComponent<T>(entity) != nullptr) {
         result.push_back(entity);
       }
     }
@@ -51,12 +437,88 @@ public:
   }
 
   void RemoveEntity(EntityId entity) {
-    components.erase(entity);
+    auto entityIt = components.find(entity);
+    if (entityIt != components.end()) {
+      Detach(entity, entityIt->second);
+      components.erase(entityIt);
+    }
     auto it = std::find(entities.begin(), entities.end(), entity);
     if (it != entities.end()) {
       entities.erase(it);
     }
   }
 
+  // One pass over the entity list for the whole batch, where RemoveEntity
+  // would search it once per entity.
+  void RemoveEntities(const std::vector<EntityId> &batch) {
+    for (auto entity : batch) {
+      auto entityIt = components.find(entity);
+      if (entityIt == components.end())
+        continue;
+      Detach(entity, entityIt->second);
+      components.erase(entityIt);
+    }
+
+    std::vector<EntityId> sorted(batch);
+    std::sort(sorted.begin(), sorted.end());
+    entities.erase(std::remove_if(entities.begin(), entities.end(),
+                                  [&sorted](EntityId entity) {
+                                    return std::binary_search(
+                                        sorted.begin(), sorted.end(), entity);
+                                  }),
+                   entities.end());
+  }
+
   const std::vector<EntityId> &GetAllEntities() const { return entities; }
+
+  // Per component type: live components and the bytes of the blocks holding
+  // them. Per subsystem: the entity list, the entity/component hash tables
+  // and the persistent queries. Vectors returned by GetEntitiesWithComponent
+  // belong to the caller and are not counted.
+  MemoryReport GetMemoryReport() const {
+    MemoryReport report;
+    for (const auto &[type, entry] : componentMemory) {
+      report.components.push_back(*entry);
+    }
+    std::sort(report.components.begin(), report.components.end(),
+              [](const MemoryEntry &a, const MemoryEntry &b) {
+                return a.name < b.name;
+              });
+
+    MemoryEntry entityList;
+    entityList.name = "Scene.entities";
+    entityList.count = entities.size();
+    entityList.elementBytes = sizeof(EntityId);
+    entityList.capacityBytes = entities.capacity() * sizeof(EntityId);
+    report.subsystems.push_back(entityList);
+
+    MemoryEntry tables;
+    tables.name = "Scene.componentTables";
+    tables.count = components.size();
+    tables.allocations = tableAllocations;
+    report.subsystems.push_back(tables);
+
+    MemoryEntry persistent;
+    persistent.name = "Scene.persistentQueries";
+    persistent.elementBytes = sizeof(EntityId);
+    for (const auto &[signature, query] : persistentQueries) {
+      persistent.count += query->members.size();
+      persistent.capacityBytes +=
+          query->matches.capacity() * sizeof(EntityId) +
+          query->members.bucket_count() * sizeof(void *) +
+          query->members.size() * (sizeof(EntityId) + sizeof(void *));
+    }
+    report.subsystems.push_back(persistent);
+
+    MemoryEntry logs;
+    logs.name = "Scene.changeLogs";
+    logs.elementBytes = sizeof(ChangeLog::Entry);
+    for (const auto &[type, log] : changeLogs) {
+      logs.count += log->entries.size();
+      logs.capacityBytes += log->entries.capacity() * sizeof(ChangeLog::Entry);
+    }
+    report.subsystems.push_back(logs);
+
+    return report;
+  }
 };
@@ -0,0 +1,141 @@
+#pragma once
+#include <atomic>
+#include <cassert>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+inline uint64_t NextEventQueueSerial() {
+  static std::atomic<uint64_t> serial{0};
+  return ++serial;
+}
+
+// Append-only queue of one event type for one frame. Producers publish into a
+// buffer of their own thread without locking, each event stamped with the
+// queue's next sequence number; Flush then merges the buffers by it into the
+// batch consumers read, so events from all threads come in publish order.
+// Flush must not overlap with Publish; debug builds assert that it does not.
+// The buffers are kept from frame to frame with their capacity, so a frame
+// like the last one allocates nothing.
+template <typename Event> class EventQueue {
+private:
+  // Events with their sequence numbers, ascending.
+  using Shard = std::vector<std::pair<uint64_t, Event>>;
+
+  uint64_t serial = NextEventQueueSerial();
+  std::atomic<uint64_t> published{0};
+  std::vector<Event> events;
+  std::mutex shardMutex;
+  std::vector<std::pair<std::thread::id, std::unique_ptr<Shard>>> shards;
+  // Per shard, the next event Flush merges; kept to not allocate.
+  std::vector<std::size_t> heads;
+#ifndef NDEBUG
+  // Publishes running, or -1 while Flush runs.
+  std::atomic<int> users{0};
+#endif
+
+  Shard &LocalShard() {
+    // Remembers the last queue of this type the thread published to.
+    struct Cache {
+      uint64_t serial = 0;
+      Shard *shard = nullptr;
+    };
+    static thread_local Cache cache;
+    if (cache.serial == serial)
+      return *cache.shard;
+
+    std::lock_guard<std::mutex> lock(shardMutex);
+    std::thread::id self = std::this_thread::get_id();
+    Shard *shard = nullptr;
+    for (auto &[owner, candidate] : shards) {
+      if (owner == self) {
+        shard = candidate.get();
+      }
+    }
+    if (!shard) {
+      shards.emplace_back(self, std::make_unique<Shard>());
+      shard = shards.back().second.get();
+    }
+    cache = {serial, shard};
+    return *shard;
+  }
+
+public:
+  void Publish(const Event &event) {
+#ifndef NDEBUG
+    int running = users.fetch_add(1);
+    assert(running >= 0 && "EventQueue::Publish during Flush");
+#endif
+    Shard &shard = LocalShard();
+    shard.emplace_back(published.fetch_add(1, std::memory_order_relaxed),
+                       event);
+#ifndef NDEBUG
+    users.fetch_sub(1);
+#endif
+  }
+
+  void Flush() {
+#ifndef NDEBUG
+    int idle = 0;
+    bool exclusive = users.compare_exchange_strong(idle, -1);
+    assert(exclusive && "EventQueue::Flush during Publish");
+#endif
+    heads.assign(shards.size(), 0);
+    for (;;) {
+      std::size_t next = shards.size();
+      uint64_t lowest = 0;
+      for (std::size_t i = 0; i < shards.size(); i++) {
+        const Shard &shard = *shards[i].second;
+        if (heads[i] < shard.size() &&
+            (next == shards.size() || shard[heads[i]].first < lowest)) {
+          next = i;
+          lowest = shard[heads[i]].first;
+        }
+      }
+      if (next == shards.size())
+        break;
+      events.push_back((*shards[next].second)[heads[next]++].second);
+    }
+    for (auto &[owner, shard] : shards) {
+      shard->clear();
+    }
+#ifndef NDEBUG
+    users = 0;
+#endif
+  }
+
+  // Everything flushed since the last Clear.
+  const std::vector<Event> &Events() const { return events; }
+
+  // Drops what was flushed. Events published since the last Flush stay for
+  // the next one, so Clear may overlap with Publish. A thread that exits
+  // leaves its empty shard behind; one reusing its id takes it over.
+  void Clear() { events.clear(); }
+};
+
+// One EventQueue per event type.
+template <typename... Types> class EventBus {
+private:
+  std::tuple<EventQueue<Types>...> queues;
+
+public:
+  template <typename Event> EventQueue<Event> &Queue() {
+    return std::get<EventQueue<Event>>(queues);
+  }
+
+  template <typename Event> void Publish(const Event &event) {
+    Queue<Event>().Publish(event);
+  }
+
+  template <typename Event> void Flush() { Queue<Event>().Flush(); }
+
+  template <typename Event> const std::vector<Event> &Events() const {
+    return std::get<EventQueue<Event>>(queues).Events();
+  }
+
+  void Clear() { (Queue<Types>().Clear(), ...); }
+};
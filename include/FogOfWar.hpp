@@ -0,0 +1,180 @@
+#pragma once
+#include "DistanceKernels.hpp"
+#include "ECS.hpp"
+#include "Heightmap.hpp"
+#include <cstdint>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+// Per-team visibility on the tile grid. Every unit stamps the cells it can
+// see into its team's grid, and a cell is visible while at least one stamp
+// covers it. A stamp is recomputed only when its unit spawns, moves or dies,
+// so static walls cost nothing after their first tick. A team's grid is kept
+// per map chunk and only for the chunks its stamps reach.
+class FogOfWar {
+private:
+  struct ChunkCoverage {
+    // Stamps covering each cell of the chunk, row-major.
+    std::vector<uint16_t> coverage;
+    // One bit per cell, set while coverage is non-zero.
+    std::vector<uint64_t> visible;
+    // Cells with non-zero coverage; the chunk is dropped at zero.
+    std::size_t covered = 0;
+  };
+
+  struct TeamGrid {
+    std::vector<std::unique_ptr<ChunkCoverage>> chunks;
+  };
+
+  struct Stamp {
+    Player team;
+    std::size_t origin;
+    std::vector<uint32_t> cells;
+  };
+
+  const Heightmap *terrain = nullptr;
+  int sightRadius = 0;
+  uint16_t blockCenti = 0;
+  TeamGrid teams[2];
+  std::unordered_map<EntityId, Stamp> stamps;
+  // Cells of the last stamp moved, reused for the next one.
+  std::vector<uint32_t> spare;
+
+  // Cells within sightRadius of (x, z) that no tile more than the block
+  // height above the viewer's own tile hides. The blocking tile itself is
+  // seen.
+  void Reveal(int x, int z, std::vector<uint32_t> &cells) const {
+    cells.clear();
+    int limit = terrain->HeightCenti(x, z) + blockCenti;
+    for (int dz = -sightRadius; dz <= sightRadius; dz++) {
+      for (int dx = -sightRadius; dx <= sightRadius; dx++) {
+        int cellX = x + dx;
+        int cellZ = z + dz;
+        if (dx * dx + dz * dz > sightRadius * sightRadius ||
+            !terrain->Contains(cellX, cellZ))
+          continue;
+
+        bool clear = TraceGridLine(x, z, cellX, cellZ, [&](int cx, int cz) {
+          return terrain->HeightCenti(cx, cz) <= limit;
+        });
+        if (clear) {
+          cells.push_back(static_cast<uint32_t>(terrain->Index(cellX, cellZ)));
+        }
+      }
+    }
+  }
+
+  void Apply(const Stamp &stamp, int delta) {
+    TeamGrid &grid = teams[static_cast<int>(stamp.team)];
+    std::size_t chunkCells =
+        std::size_t(terrain->ChunkSize()) * terrain->ChunkSize();
+    for (uint32_t cell : stamp.cells) {
+      int x = static_cast<int>(cell % terrain->Width());
+      int z = static_cast<int>(cell / terrain->Width());
+      auto &chunk = grid.chunks[terrain->ChunkOf(x, z)];
+      if (!chunk) {
+        chunk = std::make_unique<ChunkCoverage>();
+        chunk->coverage.assign(chunkCells, 0);
+        chunk->visible.assign((chunkCells + 63) / 64, 0);
+      }
+
+      std::size_t local = terrain->InChunk(x, z);
+      uint16_t &count = chunk->coverage[local];
+      uint64_t bit = uint64_t(1) << (local % 64);
+      if (count == 0) {
+        chunk->visible[local / 64] |= bit;
+        chunk->covered++;
+      }
+      count += delta;
+      if (count == 0) {
+        chunk->visible[local / 64] &= ~bit;
+        if (--chunk->covered == 0) {
+          chunk.reset();
+        }
+      }
+    }
+  }
+
+public:
+  void Reset(const Heightmap &heights, int radius, float blockHeight) {
+    terrain = &heights;
+    sightRadius = radius;
+    blockCenti = static_cast<uint16_t>(blockHeight * 100.0f + 0.5f);
+    for (auto &grid : teams) {
+      grid.chunks.clear();
+      grid.chunks.resize(heights.ChunkCount());
+    }
+    stamps.clear();
+  }
+
+  // Moves the unit's stamp to the cell; nothing happens if it is already
+  // there. The new stamp goes on before the old one comes off, so chunks
+  // both cover are kept.
+  void Place(EntityId unit, Player team, int x, int z) {
+    std::size_t origin = terrain->Index(x, z);
+    auto [it, isNew] = stamps.try_emplace(unit);
+    Stamp &stamp = it->second;
+    if (!isNew && stamp.origin == origin && stamp.team == team)
+      return;
+
+    Stamp placed{team, origin, std::move(spare)};
+    Reveal(x, z, placed.cells);
+    Apply(placed, +1);
+    if (!isNew) {
+      Apply(stamp, -1);
+    }
+    spare = std::move(stamp.cells);
+    stamp = std::move(placed);
+  }
+
+  void Remove(EntityId unit) {
+    auto it = stamps.find(unit);
+    if (it != stamps.end()) {
+      Apply(it->second, -1);
+      stamps.erase(it);
+    }
+  }
+
+  bool IsVisible(Player team, int x, int z) const {
+    const auto &chunk =
+        teams[static_cast<int>(team)].chunks[terrain->ChunkOf(x, z)];
+    if (!chunk)
+      return false;
+    std::size_t local = terrain->InChunk(x, z);
+    return (chunk->visible[local / 64] >> (local % 64)) & 1;
+  }
+
+  // TeamBit of every team that sees the cell.
+  uint32_t VisibleMask(int x, int z) const {
+    uint32_t mask = 0;
+    for (Player team : {Player::PLAYER1, Player::PLAYER2}) {
+      if (IsVisible(team, x, z)) {
+        mask |= TeamBit(team);
+      }
+    }
+    return mask;
+  }
+
+  MemoryEntry GetMemoryEntry() const {
+    MemoryEntry entry;
+    entry.name = "Match.fogOfWar";
+    entry.count = stamps.size();
+    entry.elementBytes = sizeof(Stamp);
+    for (const auto &grid : teams) {
+      entry.capacityBytes += grid.chunks.capacity() * sizeof(void *);
+      for (const auto &chunk : grid.chunks) {
+        if (!chunk)
+          continue;
+        entry.capacityBytes += sizeof(ChunkCoverage) +
+                               chunk->coverage.capacity() * sizeof(uint16_t) +
+                               chunk->visible.capacity() * sizeof(uint64_t);
+      }
+    }
+    for (const auto &[unit, stamp] : stamps) {
+      entry.capacityBytes +=
+          sizeof(Stamp) + stamp.cells.capacity() * sizeof(uint32_t);
+    }
+    return entry;
+  }
+};
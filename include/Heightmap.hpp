@@ -0,0 +1,78 @@
+#pragma once
+#include "MapFormat.hpp"
+#include <cstdint>
+#include <cstdlib>
+
+// Tile heights, in hundredths of a world unit, read straight from the cooked
+// map on every lookup. Nothing is copied up front, so a large map costs only
+// the pages of the chunks that are looked at. Cells are indexed row-major
+// across the whole map; chunks z * ChunksX() + x like the cooked tiles.
+class Heightmap {
+private:
+  const MapView *map = nullptr;
+  int width = 0;
+  int depth = 0;
+  int chunkSize = 1;
+  int chunksX = 0;
+  int chunksZ = 0;
+
+public:
+  void Attach(const MapView &view) {
+    map = &view;
+    width = static_cast<int>(view.Width());
+    depth = static_cast<int>(view.Depth());
+    chunkSize = static_cast<int>(view.ChunkSize());
+    chunksX = static_cast<int>(view.ChunksX());
+    chunksZ = static_cast<int>(view.ChunksZ());
+  }
+
+  int Width() const { return width; }
+  int Depth() const { return depth; }
+  std::size_t Index(int x, int z) const { return std::size_t(z) * width + x; }
+  bool Contains(int x, int z) const {
+    return x >= 0 && x < width && z >= 0 && z < depth;
+  }
+
+  int ChunkSize() const { return chunkSize; }
+  std::size_t ChunkCount() const { return std::size_t(chunksX) * chunksZ; }
+  std::size_t ChunkOf(int x, int z) const {
+    return std::size_t(z / chunkSize) * chunksX + x / chunkSize;
+  }
+  // Index of the cell within its chunk, row-major.
+  std::size_t InChunk(int x, int z) const {
+    return std::size_t(z % chunkSize) * chunkSize + x % chunkSize;
+  }
+
+  uint16_t HeightCenti(int x, int z) const {
+    return map->TileAt(x, z).heightCenti;
+  }
+};
+
+// Visits the cells strictly between (x0, z0) and (x1, z1) along a Bresenham
+// line, stopping early when visit returns false. Returns whether the whole
+// line was walked.
+template <typename Visit>
+bool TraceGridLine(int x0, int z0, int x1, int z1, Visit visit) {
+  int dx = std::abs(x1 - x0);
+  int dz = -std::abs(z1 - z0);
+  int stepX = x0 < x1 ? 1 : -1;
+  int stepZ = z0 < z1 ? 1 : -1;
+  int error = dx + dz;
+
+  int x = x0;
+  int z = z0;
+  while (x != x1 || z != z1) {
+    int doubled = 2 * error;
+    if (doubled >= dz) {
+      error += dz;
+      x += stepX;
+    }
+    if (doubled <= dx) {
+      error += dx;
+      z += stepZ;
+    }
+    if ((x != x1 || z != z1) && !visit(x, z))
+      return false;
+  }
+  return true;
+}
@@ -0,0 +1,72 @@
+#pragma once
+#include <coroutine>
+#include <exception>
+#include <optional>
+#include <utility>
+
+// A multi-step input interaction written as a coroutine, such as picking the
+// units to portal and then where to send them. The coroutine runs up to its
+// first `co_await Interaction<Input>::Next()` when it is created, and on to
+// the next one every time Feed hands it an input. Destroying the
+// Interaction cancels it.
+template <typename Input> class Interaction {
+public:
+  struct promise_type {
+    std::optional<Input> input;
+
+    Interaction get_return_object() {
+      return Interaction(
+          std::coroutine_handle<promise_type>::from_promise(*this));
+    }
+    std::suspend_never initial_suspend() noexcept { return {}; }
+    std::suspend_always final_suspend() noexcept { return {}; }
+    void return_void() {}
+    void unhandled_exception() { std::terminate(); }
+  };
+
+  // Suspends until the next input and evaluates to it.
+  struct Next {
+    promise_type *promise = nullptr;
+
+    bool await_ready() const noexcept { return false; }
+    void await_suspend(std::coroutine_handle<promise_type> waiting) noexcept {
+      promise = &waiting.promise();
+    }
+    Input await_resume() { return *std::exchange(promise->input, {}); }
+  };
+
+  Interaction() = default;
+  Interaction(Interaction &&other) noexcept
+      : handle(std::exchange(other.handle, {})) {}
+  Interaction &operator=(Interaction &&other) noexcept {
+    if (this != &other) {
+      Reset();
+      handle = std::exchange(other.handle, {});
+    }
+    return *this;
+  }
+  Interaction(const Interaction &) = delete;
+  Interaction &operator=(const Interaction &) = delete;
+  ~Interaction() { Reset(); }
+
+  bool Active() const { return handle && !handle.done(); }
+
+  void Feed(const Input &input) {
+    if (!Active())
+      return;
+    handle.promise().input = input;
+    handle.resume();
+  }
+
+  void Reset() {
+    if (handle) {
+      handle.destroy();
+      handle = {};
+    }
+  }
+
+private:
+  std::coroutine_handle<promise_type> handle;
+
+  explicit Interaction(std::coroutine_handle<promise_type> h) : handle(h) {}
+};
@@ -0,0 +1,202 @@
+#pragma once
+#include "ECS.hpp"
+#include "Heightmap.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <unordered_map>
+#include <vector>
+
+struct SightRay {
+  uint32_t from;
+  uint32_t to;
+};
+
+// Line of sight between tile cells over the terrain plus the walls standing
+// on it. A ray runs from eyeHeight above the start tile to eyeHeight above
+// the end tile; a cell strictly between them blocks it when its top rises
+// above the ray there. Results are cached per cell pair in a fixed table and
+// stay valid until a wall is added to or removed from a chunk the ray's
+// bounding box overlaps.
+class LineOfSight {
+private:
+  // key is from << 32 | to; zero marks an empty way, since rays from a cell
+  // to itself are never cached.
+  struct CachedRay {
+    uint64_t key = 0;
+    uint32_t traced = 0;
+    uint8_t visible = 0;
+  };
+
+  // Two ways per set, the most recently used first.
+  static constexpr int CACHE_SET_BITS = 14;
+  static constexpr std::size_t CACHE_WAYS = 2;
+
+  const Heightmap *terrain = nullptr;
+  uint16_t eyeCenti = 0;
+  uint16_t wallCenti = 0;
+  // Walls standing on each cell that has any, and per chunk, so rays only
+  // look a cell up in chunks with walls.
+  std::unordered_map<uint32_t, uint32_t> wallsPerCell;
+  std::vector<uint32_t> wallsPerChunk;
+  std::unordered_map<EntityId, uint32_t> wallCells;
+  std::vector<CachedRay> cache;
+  std::size_t cachedRays = 0;
+  std::size_t traces = 0;
+  // Ticks on every change of a cell's top; per chunk, the tick of its last
+  // change. A cached ray traced at or after that tick is still good.
+  uint32_t clock = 0;
+  std::vector<uint32_t> chunkChanged;
+
+  // Terrain plus wall height of the cell.
+  int Top(int x, int z) const {
+    int top = terrain->HeightCenti(x, z);
+    if (wallsPerChunk[terrain->ChunkOf(x, z)] > 0 &&
+        wallsPerCell.count(static_cast<uint32_t>(terrain->Index(x, z)))) {
+      top += wallCenti;
+    }
+    return top;
+  }
+
+  void AddWall(uint32_t cell) {
+    std::size_t chunk = ChunkOfCell(cell);
+    wallsPerChunk[chunk]++;
+    if (wallsPerCell[cell]++ == 0) {
+      chunkChanged[chunk] = ++clock;
+    }
+  }
+
+  void DropWall(uint32_t cell) {
+    std::size_t chunk = ChunkOfCell(cell);
+    wallsPerChunk[chunk]--;
+    auto it = wallsPerCell.find(cell);
+    if (--it->second == 0) {
+      wallsPerCell.erase(it);
+      chunkChanged[chunk] = ++clock;
+    }
+  }
+
+  // Whether no chunk the ray's bounding box overlaps changed since it was
+  // traced; the cells it crosses all lie in that box.
+  bool IsCurrent(uint32_t from, uint32_t to, uint32_t traced) const {
+    int width = terrain->Width();
+    int size = terrain->ChunkSize();
+    int x0 = static_cast<int>(from % width);
+    int z0 = static_cast<int>(from / width);
+    int x1 = static_cast<int>(to % width);
+    int z1 = static_cast<int>(to / width);
+    for (int z = std::min(z0, z1) / size; z <= std::max(z0, z1) / size; z++) {
+      for (int x = std::min(x0, x1) / size; x <= std::max(x0, x1) / size;
+           x++) {
+        if (chunkChanged[terrain->ChunkOf(x * size, z * size)] > traced)
+          return false;
+      }
+    }
+    return true;
+  }
+
+  uint8_t Lookup(uint32_t from, uint32_t to) {
+    uint64_t key = (uint64_t(from) << 32) | to;
+    std::size_t set = (key * 0x9E3779B97F4A7C15ull) >> (64 - CACHE_SET_BITS);
+    CachedRay *ways = &cache[set * CACHE_WAYS];
+    if (ways[1].key == key) {
+      std::swap(ways[0], ways[1]);
+    } else if (ways[0].key != key) {
+      cachedRays += ways[1].key == 0;
+      ways[1] = ways[0];
+      ways[0] = CachedRay();
+    }
+
+    CachedRay &ray = ways[0];
+    if (ray.key != key || !IsCurrent(from, to, ray.traced)) {
+      ray.key = key;
+      ray.traced = clock;
+      ray.visible = Trace(from, to);
+      traces++;
+    }
+    return ray.visible;
+  }
+
+  std::size_t ChunkOfCell(uint32_t cell) const {
+    return terrain->ChunkOf(static_cast<int>(cell % terrain->Width()),
+                            static_cast<int>(cell / terrain->Width()));
+  }
+
+  bool Trace(uint32_t from, uint32_t to) const {
+    int width = terrain->Width();
+    int x0 = static_cast<int>(from % width);
+    int z0 = static_cast<int>(from / width);
+    int x1 = static_cast<int>(to % width);
+    int z1 = static_cast<int>(to / width);
+
+    float h0 = terrain->HeightCenti(x0, z0) + eyeCenti;
+    float h1 = terrain->HeightCenti(x1, z1) + eyeCenti;
+    float steps = static_cast<float>(
+        std::max(std::abs(x1 - x0), std::abs(z1 - z0)));
+
+    return TraceGridLine(x0, z0, x1, z1, [&](int x, int z) {
+      float t = std::max(std::abs(x - x0), std::abs(z - z0)) / steps;
+      return Top(x, z) <= h0 + (h1 - h0) * t;
+    });
+  }
+
+public:
+  void Reset(const Heightmap &heights, float eyeHeight, float wallHeight) {
+    terrain = &heights;
+    eyeCenti = static_cast<uint16_t>(eyeHeight * 100.0f + 0.5f);
+    wallCenti = static_cast<uint16_t>(wallHeight * 100.0f + 0.5f);
+    wallsPerCell.clear();
+    wallsPerChunk.assign(heights.ChunkCount(), 0);
+    wallCells.clear();
+    cache.assign(CACHE_WAYS << CACHE_SET_BITS, CachedRay());
+    cachedRays = 0;
+    clock = 0;
+    chunkChanged.assign(heights.ChunkCount(), 0);
+  }
+
+  // Moves the wall to the cell; the cached rays around its chunk are
+  // invalidated when that changes a cell's top.
+  void PlaceWall(EntityId wall, uint32_t cell) {
+    auto [it, isNew] = wallCells.try_emplace(wall, cell);
+    if (!isNew) {
+      if (it->second == cell)
+        return;
+      DropWall(it->second);
+      it->second = cell;
+    }
+    AddWall(cell);
+  }
+
+  void RemoveWall(EntityId wall) {
+    auto it = wallCells.find(wall);
+    if (it == wallCells.end())
+      return;
+    DropWall(it->second);
+    wallCells.erase(it);
+  }
+
+  // Writes 1 to visible[i] when rays[i] is clear, 0 when it is blocked.
+  void Check(const SightRay *rays, std::size_t count, uint8_t *visible) {
+    for (std::size_t i = 0; i < count; i++) {
+      const SightRay &ray = rays[i];
+      visible[i] = ray.from == ray.to ? 1 : Lookup(ray.from, ray.to);
+    }
+  }
+
+  // Rays traced so far rather than answered from the cache.
+  std::size_t Traces() const { return traces; }
+
+  MemoryEntry GetMemoryEntry() const {
+    MemoryEntry entry;
+    entry.name = "Match.lineOfSight";
+    entry.count = cachedRays;
+    entry.elementBytes = sizeof(CachedRay);
+    entry.capacityBytes =
+        wallsPerCell.size() * (2 * sizeof(uint32_t) + sizeof(void *)) +
+        (wallsPerChunk.capacity() + chunkChanged.capacity()) *
+            sizeof(uint32_t) +
+        wallCells.size() * (sizeof(EntityId) + sizeof(uint32_t)) +
+        cache.capacity() * sizeof(CachedRay);
+    return entry;
+  }
+};
@@ -0,0 +1,134 @@
+#pragma once
+#include "MapFormat.hpp"
+#include <map>
+#include <nlohmann/json.hpp>
+#include <stdexcept>
+#include <string>
+
+// Parsing of the JSON map descriptions that map_cooker turns into cooked
+// maps. Every function throws std::runtime_error, or a json exception for
+// missing or mistyped fields, on a malformed description.
+//
+// Tiles are painted in order: "fill" covers the whole map, then every
+// "regions" rectangle, then the "rows" strings if present (one character per
+// tile, looked up in "legend"). Players are 1 and 2, cells are grid indices
+// with x along the width and z along the depth.
+
+using json = nlohmann::json;
+
+inline const std::map<std::string, TerrainType> TERRAIN_NAMES = {
+    {"grass", TerrainType::GRASS}, {"water", TerrainType::WATER},
+    {"stone", TerrainType::STONE}, {"dirt", TerrainType::DIRT},
+    {"sand", TerrainType::SAND},
+};
+
+// Heights are stored in hundredths in 16 bits, so a little more would fit.
+const float MAX_TILE_HEIGHT = 655.0f;
+
+inline CookedTile ParseTile(const json &node) {
+  std::string name = node.at("type");
+  auto it = TERRAIN_NAMES.find(name);
+  if (it == TERRAIN_NAMES.end())
+    throw std::runtime_error("unknown terrain type \"" + name + "\"");
+  float height = node.value("height", 1.0f);
+  if (!(height >= 0.0f && height <= MAX_TILE_HEIGHT))
+    throw std::runtime_error("tile heights must be between 0 and 655");
+  return MakeCookedTile(it->second, height);
+}
+
+inline uint8_t ParsePlayer(const json &node) {
+  int player = node.at("player");
+  if (player != 1 && player != 2)
+    throw std::runtime_error("player must be 1 or 2");
+  return static_cast<uint8_t>(player - 1);
+}
+
+inline void CheckCell(const MapSource &source, uint32_t x, uint32_t z) {
+  if (x >= source.width || z >= source.depth)
+    throw std::runtime_error("cell (" + std::to_string(x) + ", " +
+                             std::to_string(z) + ") is outside the map");
+}
+
+inline MapObject ParseObject(const MapSource &source, const json &node) {
+  MapObject object = {ParsePlayer(node), 0, node.at("x"), node.at("z")};
+  CheckCell(source, object.x, object.z);
+  return object;
+}
+
+inline MapSource ParseMap(const json &root) {
+  MapSource source;
+  source.width = root.at("width");
+  source.depth = root.at("depth");
+  source.chunkSize = root.value("chunkSize", source.chunkSize);
+  if (source.width == 0 || source.depth == 0 || source.chunkSize == 0 ||
+      source.width > 0xFFFF || source.depth > 0xFFFF ||
+      source.chunkSize > 0xFFFF)
+    throw std::runtime_error("width, depth and chunkSize must be positive "
+                             "and at most 65535");
+
+  source.tiles.assign(std::size_t(source.width) * source.depth,
+                      ParseTile(root.value("fill", json{{"type", "grass"}})));
+
+  for (const auto &region : root.value("regions", json::array())) {
+    CookedTile tile = ParseTile(region.at("tile"));
+    uint32_t x = region.at("x"), z = region.at("z");
+    uint32_t width = region.value("width", 1u);
+    uint32_t depth = region.value("depth", 1u);
+    CheckCell(source, x + width - 1, z + depth - 1);
+    for (uint32_t dz = 0; dz < depth; dz++) {
+      for (uint32_t dx = 0; dx < width; dx++) {
+        source.tiles[std::size_t(z + dz) * source.width + x + dx] = tile;
+      }
+    }
+  }
+
+  if (root.contains("rows")) {
+    std::map<char, CookedTile> legend;
+    for (const auto &[key, value] : root.at("legend").items()) {
+      if (key.size() != 1)
+        throw std::runtime_error("legend keys must be single characters");
+      legend[key[0]] = ParseTile(value);
+    }
+
+    const json &rows = root.at("rows");
+    if (rows.size() != source.depth)
+      throw std::runtime_error("rows must have one string per row");
+    for (uint32_t z = 0; z < source.depth; z++) {
+      std::string row = rows[z];
+      if (row.size() != source.width)
+        throw std::runtime_error("row " + std::to_string(z) +
+                                 " must have one character per column");
+      for (uint32_t x = 0; x < source.width; x++) {
+        auto it = legend.find(row[x]);
+        if (it == legend.end())
+          throw std::runtime_error(std::string("no legend entry for '") +
+                                   row[x] + "'");
+        source.tiles[std::size_t(z) * source.width + x] = it->second;
+      }
+    }
+  }
+
+  for (const auto &zone : root.value("spawnZones", json::array())) {
+    MapSpawnZone spawnZone = {ParsePlayer(zone), 0, zone.at("x"), zone.at("z"),
+                              zone.at("width"), zone.at("depth")};
+    CheckCell(source, spawnZone.x + spawnZone.width - 1,
+              spawnZone.z + spawnZone.depth - 1);
+    source.spawnZones.push_back(spawnZone);
+  }
+
+  bool hasReactor[2] = {false, false};
+  for (const auto &reactor : root.at("reactors")) {
+    MapObject object = ParseObject(source, reactor);
+    if (hasReactor[object.player])
+      throw std::runtime_error("each player has exactly one reactor");
+    hasReactor[object.player] = true;
+    source.reactors.push_back(object);
+  }
+  if (!hasReactor[0] || !hasReactor[1])
+    throw std::runtime_error("each player has exactly one reactor");
+
+  for (const auto &wall : root.value("walls", json::array())) {
+    source.walls.push_back(ParseObject(source, wall));
+  }
+  return source;
+}
@@ -0,0 +1,360 @@
+#pragma once
+#include "entity-components/Player.hpp"
+#include "entity-components/Tile.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#include <fstream>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// Cooked map layout, little-endian, all offsets from the start of the file:
+//
+//   MapHeader
+//   tiles       chunksX * chunksZ chunks of chunkSize * chunkSize CookedTiles,
+//               chunk-major so one chunk is one contiguous run of pages
+//   spawnZones  MapSpawnZone[spawnZoneCount]
+//   reactors    MapObject[reactorCount]
+//   walls       MapObject[wallCount]
+//
+// Tiles of edge chunks that fall outside the map are zero padding.
+
+const char MAP_MAGIC[4] = {'M', 'I', 'H', 'M'};
+const uint32_t MAP_VERSION = 1;
+
+struct MapHeader {
+  char magic[4];
+  uint32_t version;
+  uint32_t width;
+  uint32_t depth;
+  uint32_t chunkSize;
+  uint32_t chunksX;
+  uint32_t chunksZ;
+  uint32_t spawnZoneCount;
+  uint32_t reactorCount;
+  uint32_t wallCount;
+  uint64_t tilesOffset;
+  uint64_t spawnZonesOffset;
+  uint64_t reactorsOffset;
+  uint64_t wallsOffset;
+};
+static_assert(sizeof(MapHeader) == 72, "MapHeader layout");
+
+struct CookedTile {
+  uint8_t type;
+  uint8_t flags;
+  // Hundredths of a world unit.
+  uint16_t heightCenti;
+
+  TerrainType Type() const { return static_cast<TerrainType>(type); }
+  float Height() const { return heightCenti / 100.0f; }
+};
+static_assert(sizeof(CookedTile) == 4, "CookedTile layout");
+
+// Cells are grid indices, x along the width and z along the depth.
+struct MapSpawnZone {
+  uint8_t player;
+  uint8_t reserved;
+  uint16_t x;
+  uint16_t z;
+  uint16_t width;
+  uint16_t depth;
+
+  bool Contains(uint32_t cellX, uint32_t cellZ) const {
+    return cellX >= x && cellX < x + width && cellZ >= z && cellZ < z + depth;
+  }
+};
+static_assert(sizeof(MapSpawnZone) == 10, "MapSpawnZone layout");
+
+struct MapObject {
+  uint8_t player;
+  uint8_t reserved;
+  uint16_t x;
+  uint16_t z;
+};
+static_assert(sizeof(MapObject) == 6, "MapObject layout");
+
+inline CookedTile MakeCookedTile(TerrainType type, float height) {
+  return {static_cast<uint8_t>(type), 0,
+          static_cast<uint16_t>(height * 100.0f + 0.5f)};
+}
+
+// A map before cooking: tiles row-major, index z * width + x.
+struct MapSource {
+  uint32_t width = 0;
+  uint32_t depth = 0;
+  uint32_t chunkSize = 32;
+  std::vector<CookedTile> tiles;
+  std::vector<MapSpawnZone> spawnZones;
+  std::vector<MapObject> reactors;
+  std::vector<MapObject> walls;
+};
+
+// The classic layout: grass with a raised dirt ridge across the middle row and
+// one reactor per side, no spawn restrictions.
+inline MapSource DefaultMapSource(uint32_t size) {
+  MapSource source;
+  source.width = size;
+  source.depth = size;
+  source.tiles.resize(size * size, MakeCookedTile(TerrainType::GRASS, 1.0f));
+  for (uint32_t x = 0; x < size; x++) {
+    source.tiles[(size / 2) * size + x] =
+        MakeCookedTile(TerrainType::DIRT, 6.0f);
+  }
+
+  uint16_t middle = static_cast<uint16_t>(size / 2);
+  source.reactors.push_back({0, 0, middle, 1});
+  source.reactors.push_back({1, 0, middle, static_cast<uint16_t>(size - 2)});
+  return source;
+}
+
+inline std::vector<uint8_t> CookMap(const MapSource &source) {
+  MapHeader header = {};
+  std::memcpy(header.magic, MAP_MAGIC, sizeof(MAP_MAGIC));
+  header.version = MAP_VERSION;
+  header.width = source.width;
+  header.depth = source.depth;
+  header.chunkSize = source.chunkSize;
+  header.chunksX = (source.width + source.chunkSize - 1) / source.chunkSize;
+  header.chunksZ = (source.depth + source.chunkSize - 1) / source.chunkSize;
+  header.spawnZoneCount = static_cast<uint32_t>(source.spawnZones.size());
+  header.reactorCount = static_cast<uint32_t>(source.reactors.size());
+  header.wallCount = static_cast<uint32_t>(source.walls.size());
+
+  uint64_t tilesPerChunk = uint64_t(source.chunkSize) * source.chunkSize;
+  header.tilesOffset = sizeof(MapHeader);
+  header.spawnZonesOffset =
+      header.tilesOffset + uint64_t(header.chunksX) * header.chunksZ *
+                               tilesPerChunk * sizeof(CookedTile);
+  header.reactorsOffset =
+      header.spawnZonesOffset + source.spawnZones.size() * sizeof(MapSpawnZone);
+  header.wallsOffset =
+      header.reactorsOffset + source.reactors.size() * sizeof(MapObject);
+  uint64_t size = header.wallsOffset + source.walls.size() * sizeof(MapObject);
+
+  std::vector<uint8_t> bytes(size, 0);
+  std::memcpy(bytes.data(), &header, sizeof(header));
+
+  CookedTile *tiles =
+      reinterpret_cast<CookedTile *>(bytes.data() + header.tilesOffset);
+  for (uint32_t z = 0; z < source.depth; z++) {
+    for (uint32_t x = 0; x < source.width; x++) {
+      uint64_t chunk = uint64_t(z / source.chunkSize) * header.chunksX +
+                       x / source.chunkSize;
+      uint64_t local = (z % source.chunkSize) * source.chunkSize +
+                       x % source.chunkSize;
+      tiles[chunk * tilesPerChunk + local] =
+          source.tiles[uint64_t(z) * source.width + x];
+    }
+  }
+
+  // std::copy rather than memcpy: the lists may be empty with null data().
+  std::copy(source.spawnZones.begin(), source.spawnZones.end(),
+            reinterpret_cast<MapSpawnZone *>(bytes.data() +
+                                             header.spawnZonesOffset));
+  std::copy(source.reactors.begin(), source.reactors.end(),
+            reinterpret_cast<MapObject *>(bytes.data() +
+                                          header.reactorsOffset));
+  std::copy(source.walls.begin(), source.walls.end(),
+            reinterpret_cast<MapObject *>(bytes.data() + header.wallsOffset));
+  return bytes;
+}
+
+// Read-only memory mapping of a whole file. Pages are only read from disk
+// when first touched, so opening a large map costs nothing up front.
+class MappedFile {
+private:
+  const uint8_t *data = nullptr;
+  std::size_t size = 0;
+#ifdef _WIN32
+  std::vector<uint8_t> buffer;
+#endif
+
+public:
+  MappedFile() = default;
+  MappedFile(const MappedFile &) = delete;
+  MappedFile &operator=(const MappedFile &) = delete;
+  ~MappedFile() { Close(); }
+
+  bool Open(const std::string &path) {
+    Close();
+#ifdef _WIN32
+    std::ifstream file(path, std::ios::binary);
+    if (!file)
+      return false;
+    buffer.assign(std::istreambuf_iterator<char>(file),
+                  std::istreambuf_iterator<char>());
+    data = buffer.data();
+    size = buffer.size();
+    return true;
+#else
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+      return false;
+
+    struct stat info;
+    if (fstat(fd, &info) != 0 || info.st_size == 0) {
+      close(fd);
+      return false;
+    }
+
+    void *mapping = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED)
+      return false;
+
+    data = static_cast<const uint8_t *>(mapping);
+    size = static_cast<std::size_t>(info.st_size);
+    return true;
+#endif
+  }
+
+  void Close() {
+#ifdef _WIN32
+    buffer.clear();
+#else
+    if (data) {
+      munmap(const_cast<uint8_t *>(data), size);
+    }
+#endif
+    data = nullptr;
+    size = 0;
+  }
+
+  const uint8_t *Data() const { return data; }
+  std::size_t Size() const { return size; }
+
+  // Drops the pages covering [offset, offset + length) from memory; they are
+  // read back from the file when next touched.
+  void Release(std::size_t offset, std::size_t length) {
+#ifndef _WIN32
+    if (!data || offset >= size)
+      return;
+    std::size_t page = static_cast<std::size_t>(sysconf(_SC_PAGESIZE));
+    std::size_t begin = offset / page * page;
+    std::size_t end = std::min(offset + length, size);
+    madvise(const_cast<uint8_t *>(data) + begin, end - begin, MADV_DONTNEED);
+#endif
+  }
+};
+
+// Validated view over cooked map bytes, either a MappedFile or a buffer
+// returned by CookMap. Accessors return pointers straight into those bytes.
+class MapView {
+private:
+  const uint8_t *base = nullptr;
+  const MapHeader *header = nullptr;
+
+  template <typename T> const T *At(uint64_t offset) const {
+    return reinterpret_cast<const T *>(base + offset);
+  }
+
+  // Whether count Ts fit at offset within size bytes, properly aligned.
+  // Written so that no part of it can overflow.
+  template <typename T>
+  static bool Fits(uint64_t offset, uint64_t count, std::size_t size) {
+    return offset % alignof(T) == 0 && offset <= size &&
+           count <= (size - offset) / sizeof(T);
+  }
+
+  static bool ValidObject(const MapHeader &h, const MapObject &object) {
+    return object.player < 2 && object.x < h.width && object.z < h.depth;
+  }
+
+  static bool ValidZone(const MapHeader &h, const MapSpawnZone &zone) {
+    return zone.player < 2 && uint32_t(zone.x) + zone.width <= h.width &&
+           uint32_t(zone.z) + zone.depth <= h.depth;
+  }
+
+public:
+  // Checks everything the game reads without further checks: the header,
+  // that every section lies within the data, that every object is on the
+  // map and belongs to a player, and that each player has exactly one
+  // reactor. The map is at most 65535 tiles across, like the cooker writes
+  // it.
+  bool Attach(const uint8_t *data, std::size_t size) {
+    base = nullptr;
+    header = nullptr;
+    if (!data || size < sizeof(MapHeader))
+      return false;
+
+    const MapHeader *h = reinterpret_cast<const MapHeader *>(data);
+    if (std::memcmp(h->magic, MAP_MAGIC, sizeof(MAP_MAGIC)) != 0 ||
+        h->version != MAP_VERSION || h->chunkSize == 0 || h->width == 0 ||
+        h->depth == 0 || h->width > 0xFFFF || h->depth > 0xFFFF ||
+        h->chunkSize > 0xFFFF ||
+        h->chunksX != (h->width + h->chunkSize - 1) / h->chunkSize ||
+        h->chunksZ != (h->depth + h->chunkSize - 1) / h->chunkSize)
+      return false;
+
+    // At most 2^34 tiles, given the limits above.
+    uint64_t tileCount =
+        uint64_t(h->chunksX) * h->chunkSize * h->chunksZ * h->chunkSize;
+    if (!Fits<CookedTile>(h->tilesOffset, tileCount, size) ||
+        !Fits<MapSpawnZone>(h->spawnZonesOffset, h->spawnZoneCount, size) ||
+        !Fits<MapObject>(h->reactorsOffset, h->reactorCount, size) ||
+        !Fits<MapObject>(h->wallsOffset, h->wallCount, size))
+      return false;
+
+    const auto *zones =
+        reinterpret_cast<const MapSpawnZone *>(data + h->spawnZonesOffset);
+    const auto *reactors =
+        reinterpret_cast<const MapObject *>(data + h->reactorsOffset);
+    const auto *walls =
+        reinterpret_cast<const MapObject *>(data + h->wallsOffset);
+    if (!std::all_of(zones, zones + h->spawnZoneCount,
+                     [h](const MapSpawnZone &z) { return ValidZone(*h, z); }) ||
+        !std::all_of(reactors, reactors + h->reactorCount,
+                     [h](const MapObject &o) { return ValidObject(*h, o); }) ||
+        !std::all_of(walls, walls + h->wallCount,
+                     [h](const MapObject &o) { return ValidObject(*h, o); }))
+      return false;
+    if (h->reactorCount != 2 || reactors[0].player == reactors[1].player)
+      return false;
+
+    base = data;
+    header = h;
+    return true;
+  }
+
+  bool IsValid() const { return header != nullptr; }
+  uint32_t Width() const { return header->width; }
+  uint32_t Depth() const { return header->depth; }
+  uint32_t ChunkSize() const { return header->chunkSize; }
+  uint32_t ChunksX() const { return header->chunksX; }
+  uint32_t ChunksZ() const { return header->chunksZ; }
+
+  // chunkSize * chunkSize tiles, row-major within the chunk.
+  const CookedTile *Chunk(uint32_t chunkX, uint32_t chunkZ) const {
+    uint64_t tilesPerChunk = uint64_t(header->chunkSize) * header->chunkSize;
+    uint64_t chunk = uint64_t(chunkZ) * header->chunksX + chunkX;
+    return At<CookedTile>(header->tilesOffset) + chunk * tilesPerChunk;
+  }
+
+  const CookedTile &TileAt(uint32_t x, uint32_t z) const {
+    uint32_t size = header->chunkSize;
+    return Chunk(x / size, z / size)[(z % size) * size + x % size];
+  }
+
+  const MapSpawnZone *SpawnZones() const {
+    return At<MapSpawnZone>(header->spawnZonesOffset);
+  }
+  uint32_t SpawnZoneCount() const { return header->spawnZoneCount; }
+
+  const MapObject *Reactors() const {
+    return At<MapObject>(header->reactorsOffset);
+  }
+  uint32_t ReactorCount() const { return header->reactorCount; }
+
+  const MapObject *Walls() const { return At<MapObject>(header->wallsOffset); }
+  uint32_t WallCount() const { return header->wallCount; }
+};
@@ -0,0 +1,1029 @@
+#pragma once
+#include "Commands.hpp"
+#include "DistanceKernels.hpp"
+#include "ECS.hpp"
+#include "EventBus.hpp"
+#include "FogOfWar.hpp"
+#include "Heightmap.hpp"
+#include "LineOfSight.hpp"
+#include "MapFormat.hpp"
+#include "Prefab.hpp"
+#include "Projectiles.hpp"
+#include "WorldChunks.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <optional>
+#include <random>
+#include <raylib.h>
+#include <raymath.h>
+#include <unordered_map>
+
+const int gridSize = 17;
+const float tileSize = 2.0f;
+const uint32_t ALL_TEAMS = TeamBit(Player::PLAYER1) | TeamBit(Player::PLAYER2);
+
+// Tunable rules of a match. The defaults are the values the game ships with.
+struct MatchConfig {
+  // Cooked map to play on; empty for the built-in gridSize ridge map.
+  std::string mapPath;
+
+  int startingPoints = 1000;
+  int attackerCost = 100;
+  int wallCost = 150;
+  int portalCost = 200;
+
+  float attackerDamage = 10.0f;
+  float attackerRange = 4.0f * 4;
+  float attackerCooldown = 1.0f;
+  float attackerHealth = 50.0f;
+  float wallDefense = 5.0f;
+  float wallBlockChance = 0.3f;
+  float wallHealth = 75.0f;
+  float reactorHealth = 100.0f;
+
+  // Chunks within activeChunkRadius of the focus are simulated every tick,
+  // the others every dormantTickInterval ticks. Chunks without units are
+  // paged out after pageOutTicks out of view. Without a focus every chunk is
+  // active, and loaded on the first tick.
+  int activeChunkRadius = 1;
+  int dormantTickInterval = 8;
+  long pageOutTicks = 600;
+
+  // Units see sightRadius cells around them, except past tiles more than
+  // sightBlockHeight above their own; attackers only target what their team
+  // sees.
+  bool fogOfWar = true;
+  int sightRadius = 9;
+  float sightBlockHeight = 2.0f;
+
+  // Attackers only acquire targets they have a clear line to, over the
+  // terrain and the walls on it.
+  bool lineOfSight = true;
+  float eyeHeight = 1.0f;
+  float wallHeight = 2.0f;
+
+  // Attackers fire projectiles that travel at projectileSpeed and deal their
+  // damage on impact; without them, or without a positive speed, shots land
+  // the moment they are fired.
+  bool projectiles = true;
+  float projectileSpeed = 24.0f;
+
+  // Attack particles are only worth spawning when someone watches.
+  bool cosmetics = true;
+  unsigned seed = 0;
+};
+
+// An attacker fired at a target in range.
+struct ProjectileFiredEvent {
+  EntityId shooter;
+  EntityId target;
+  Player team;
+  float damage;
+};
+
+// A shot reached target, which need not be the unit it was fired at.
+struct ProjectileHitEvent {
+  EntityId shooter;
+  EntityId target;
+  Player team;
+  float damage;
+};
+
+// A shot landed; dealt is what was left of damage after the target's defense.
+struct DamageEvent {
+  EntityId source;
+  EntityId target;
+  Player team;
+  float damage;
+  float dealt;
+};
+
+// A unit or reactor was killed by team's shot.
+struct DeathEvent {
+  EntityId entity;
+  Player killer;
+  float dealt;
+};
+
+using MatchEvents = EventBus<ProjectileFiredEvent, ProjectileHitEvent,
+                             DamageEvent, DeathEvent>;
+
+// The simulation half of the game: scene, economy and combat rules. It never
+// touches the window or input, so many matches can run side by side headless.
+class Match {
+private:
+  MatchConfig config;
+  MappedFile mapFile;
+  std::vector<uint8_t> builtinMap;
+  MapView map;
+  ChunkGrid chunks;
+  std::optional<Vector3> focus;
+  // Chunk each unit was last counted in, and the change tick of that count.
+  std::unordered_map<EntityId, std::size_t> unitChunks;
+  uint32_t unitsSeen = 0;
+  Heightmap terrain;
+  FogOfWar fog;
+  uint32_t fogSeen = 0;
+  // Units that moved in a sleeping chunk, restamped on its next step.
+  std::vector<EntityId> fogDeferred;
+  LineOfSight sight;
+  uint32_t wallsSeen = 0;
+  // Targets in range of the attacker being resolved, nearest first, and the
+  // rays to them.
+  std::vector<std::pair<float, std::size_t>> inRange;
+  std::vector<SightRay> sightRays;
+  std::vector<uint8_t> sightResults;
+  Scene scene;
+  std::unordered_map<Player, int> points;
+  EntityId player1Reactor = -1;
+  EntityId player2Reactor = -1;
+  ParticleSystem particleSystem;
+  std::unordered_map<Player, Prefab> attackerPrefabs;
+  std::unordered_map<Player, Prefab> wallPrefabs;
+  std::unordered_map<Player, Prefab> reactorPrefabs;
+  std::unordered_map<Player, Prefab> portalPrefabs;
+  PositionBuffer candidateBuffer;
+  ProjectilePool projectiles;
+  // How long each projectile flies this tick, the units projectiles can hit,
+  // and what they hit.
+  std::vector<float> projectileSteps;
+  PositionBuffer hittable;
+  std::vector<ProjectilePool::Hit> projectileHits;
+  std::vector<uint8_t> candidateMask;
+  std::vector<EntityId> simulated;
+  // Units removed by the last RemoveDead.
+  std::vector<EntityId> fallen;
+  // This tick's events; cleared when the next one begins.
+  MatchEvents events;
+  // Commands submitted since the last ApplyCommands, and the spawns it
+  // batches them into.
+  EventQueue<Command> commands;
+  std::vector<Vector3> attackerSpawns[2];
+  std::vector<Vector3> wallSpawns[2];
+  std::mt19937 rng;
+  long tick = 0;
+  long lastAttackTick = 0;
+
+public:
+  explicit Match(const MatchConfig &cfg = MatchConfig())
+      : config(cfg), rng(cfg.seed) {
+    LoadMap();
+    InitializePrefabs();
+    InitializeGrid();
+    InitializeGame();
+  }
+
+  Scene &GetScene() { return scene; }
+  ParticleSystem &GetParticles() { return particleSystem; }
+  const MatchConfig &GetConfig() const { return config; }
+  const MapView &GetMap() const { return map; }
+  const ChunkGrid &GetChunks() const { return chunks; }
+  const FogOfWar &GetFog() const { return fog; }
+  const ProjectilePool &GetProjectiles() const { return projectiles; }
+  int GetPoints(Player player) { return points[player]; }
+  long GetTick() const { return tick; }
+  const std::vector<EntityId> &GetFallen() const { return fallen; }
+  const MatchEvents &GetEvents() const { return events; }
+  long GetLastAttackTick() const { return lastAttackTick; }
+
+  MemoryReport GetMemoryReport() const {
+    MemoryReport report = scene.GetMemoryReport();
+    report.subsystems.push_back(particleSystem.GetMemoryEntry());
+
+    MemoryEntry candidates;
+    candidates.name = "Match.candidateBuffer";
+    candidates.count = candidateBuffer.Size();
+    candidates.elementBytes =
+        3 * sizeof(float) + sizeof(uint8_t) + sizeof(EntityId);
+    candidates.capacityBytes =
+        candidateBuffer.entities.capacity() * candidates.elementBytes +
+        candidateMask.capacity();
+    report.subsystems.push_back(candidates);
+
+    MemoryEntry chunkTable;
+    chunkTable.name = "Match.chunks";
+    chunkTable.count = chunks.Count() - chunks.CountIn(ChunkState::PAGED_OUT);
+    chunkTable.elementBytes = sizeof(WorldChunk);
+    chunkTable.capacityBytes = chunks.Count() * sizeof(WorldChunk);
+    for (std::size_t i : chunks.Resident()) {
+      chunkTable.capacityBytes += chunks[i].tiles.capacity() * sizeof(EntityId);
+    }
+    report.subsystems.push_back(chunkTable);
+    report.subsystems.push_back(fog.GetMemoryEntry());
+    report.subsystems.push_back(sight.GetMemoryEntry());
+    report.subsystems.push_back(projectiles.GetMemoryEntry());
+    return report;
+  }
+
+  EntityId GetReactor(Player player) const {
+    return player == Player::PLAYER1 ? player1Reactor : player2Reactor;
+  }
+
+  void InitializePrefabs() {
+    for (Player owner : {Player::PLAYER1, Player::PLAYER2}) {
+      bool isFirst = owner == Player::PLAYER1;
+
+      attackerPrefabs[owner]
+          .With<RenderableET>(isFirst ? BLUE : RED, EntityType::ATTACKER, 2.0f,
+                              2.0f)
+          .With<AttackerET>(config.attackerDamage, config.attackerRange,
+                            config.attackerCooldown)
+          .With<HealthET>(config.attackerHealth)
+          .With<PlayerET>(owner);
+
+      wallPrefabs[owner]
+          .With<RenderableET>(isFirst ? DARKGREEN : DARKPURPLE,
+                              EntityType::WALL, 2.0f, 2.0f)
+          .With<DefenderET>(config.wallDefense, config.wallBlockChance)
+          .With<HealthET>(config.wallHealth)
+          .With<PlayerET>(owner);
+
+      reactorPrefabs[owner]
+          .With<RenderableET>(isFirst ? BLUE : RED, EntityType::REACTOR, 1.0f,
+                              6.0f)
+          .With<HealthET>(config.reactorHealth)
+          .With<PlayerET>(owner);
+
+      portalPrefabs[owner]
+          .With<RenderableET>(isFirst ? BLUE : RED, EntityType::PORTAL, 2.0f,
+                              0.5f)
+          .With<PortalET>()
+          .With<PlayerET>(owner);
+    }
+  }
+
+  void LoadMap() {
+    if (!config.mapPath.empty()) {
+      if (mapFile.Open(config.mapPath) &&
+          map.Attach(mapFile.Data(), mapFile.Size()))
+        return;
+      std::fprintf(stderr, "Cannot load map %s, using the built-in map\n",
+                   config.mapPath.c_str());
+    }
+
+    builtinMap = CookMap(DefaultMapSource(gridSize));
+    map.Attach(builtinMap.data(), builtinMap.size());
+  }
+
+  // Cells are centred on the origin, one tileSize apart.
+  Vector3 CellToWorld(int x, int z, float y) const {
+    int halfWidth = static_cast<int>(map.Width()) / 2;
+    int halfDepth = static_cast<int>(map.Depth()) / 2;
+    return {static_cast<float>((x - halfWidth) * tileSize), y,
+            static_cast<float>((z - halfDepth) * tileSize)};
+  }
+
+  bool WorldToCell(const Vector3 &position, int &x, int &z) const {
+    x = static_cast<int>(round(position.x / tileSize)) +
+        static_cast<int>(map.Width()) / 2;
+    z = static_cast<int>(round(position.z / tileSize)) +
+        static_cast<int>(map.Depth()) / 2;
+    return x >= 0 && x < static_cast<int>(map.Width()) && z >= 0 &&
+           z < static_cast<int>(map.Depth());
+  }
+
+  // Position for an object of the given height standing on the cell's tile.
+  Vector3 StandOnCell(int x, int z, float height) const {
+    return CellToWorld(x, z, map.TileAt(x, z).Height() + height / 2.0f);
+  }
+
+  std::size_t ChunkOf(const Vector3 &position) const {
+    int x, z;
+    WorldToCell(position, x, z);
+    x = std::clamp(x, 0, static_cast<int>(map.Width()) - 1);
+    z = std::clamp(z, 0, static_cast<int>(map.Depth()) - 1);
+    return chunks.Index(x / map.ChunkSize(), z / map.ChunkSize());
+  }
+
+  void LoadChunk(uint32_t chunkX, uint32_t chunkZ) {
+    const CookedTile *cooked = map.Chunk(chunkX, chunkZ);
+    uint32_t size = map.ChunkSize();
+
+    std::vector<TransformET> transforms;
+    std::vector<TileET> tiles;
+    transforms.reserve(size * size);
+    tiles.reserve(size * size);
+
+    for (uint32_t localZ = 0; localZ < size; localZ++) {
+      for (uint32_t localX = 0; localX < size; localX++) {
+        uint32_t x = chunkX * size + localX;
+        uint32_t z = chunkZ * size + localZ;
+        if (x >= map.Width() || z >= map.Depth())
+          continue;
+
+        const CookedTile &tile = cooked[localZ * size + localX];
+        transforms.emplace_back(CellToWorld(x, z, tile.Height() / 2.0f));
+        tiles.emplace_back(tile.Type(), tile.Height());
+      }
+    }
+
+    std::vector<EntityId> batch = scene.NewEntities(tiles.size(), 2);
+    scene.AssignBatch<TransformET>(batch, std::move(transforms));
+    scene.AssignBatch<TileET>(batch, std::move(tiles));
+    chunks[chunks.Index(chunkX, chunkZ)].tiles = std::move(batch);
+  }
+
+  // Removes the chunk's tile entities and lets the OS drop its map pages.
+  void UnloadChunk(uint32_t chunkX, uint32_t chunkZ) {
+    WorldChunk &chunk = chunks[chunks.Index(chunkX, chunkZ)];
+    scene.RemoveEntities(chunk.tiles);
+    chunk.tiles.clear();
+    chunk.tiles.shrink_to_fit();
+
+    if (mapFile.Data()) {
+      const uint8_t *bytes =
+          reinterpret_cast<const uint8_t *>(map.Chunk(chunkX, chunkZ));
+      mapFile.Release(bytes - mapFile.Data(), std::size_t(map.ChunkSize()) *
+                                                  map.ChunkSize() *
+                                                  sizeof(CookedTile));
+    }
+  }
+
+  void InitializeGrid() {
+    terrain.Attach(map);
+    fog.Reset(terrain, config.sightRadius, config.sightBlockHeight);
+    sight.Reset(terrain, config.eyeHeight, config.wallHeight);
+    projectiles.Reset(terrain.Width(), terrain.Depth(), tileSize,
+                      tileSize / 2);
+    // Every chunk starts paged out; the first UpdateStreaming loads the ones
+    // around the focus and those holding units.
+    chunks.Reset(map.ChunksX(), map.ChunksZ());
+  }
+
+  // The point the player looks at; chunks around it are simulated at full
+  // rate.
+  void SetFocus(const Vector3 &position) { focus = position; }
+  void ClearFocus() { focus.reset(); }
+
+  // Moves the units whose transform changed since the last pass to their
+  // current chunk. Units that die are dropped in RemoveDead.
+  void UpdateUnitChunks() {
+    scene.QueryChanged<TransformET, PlayerET>(unitsSeen, [this](EntityId unit) {
+      std::size_t chunk =
+          ChunkOf(scene.ReadComponent<TransformET>(unit)->position);
+      auto [it, isNew] = unitChunks.try_emplace(unit, chunk);
+      if (!isNew) {
+        if (it->second == chunk)
+          return;
+        chunks[it->second].units--;
+        it->second = chunk;
+      }
+      chunks[chunk].units++;
+      chunks.Queue(chunk);
+    });
+    unitsSeen = scene.AdvanceChangeTick();
+  }
+
+  void ForgetUnit(EntityId unit) {
+    auto it = unitChunks.find(unit);
+    if (it != unitChunks.end()) {
+      chunks[it->second].units--;
+      unitChunks.erase(it);
+    }
+  }
+
+  // Moves every chunk to the state it should be in, instantiating or
+  // dropping its tiles on the way. Only the resident chunks, those around
+  // the focus and those a unit entered can change, so only they are visited.
+  void UpdateStreaming() {
+    UpdateUnitChunks();
+
+    std::size_t focusChunk = focus ? ChunkOf(*focus) : 0;
+    if (focus) {
+      chunks.QueueAround(focusChunk, config.activeChunkRadius);
+    } else if (chunks.Resident().size() < chunks.Count()) {
+      for (std::size_t i = 0; i < chunks.Count(); i++) {
+        chunks.Queue(i);
+      }
+    }
+
+    for (std::size_t i : chunks.Due()) {
+      ChunkState state = chunks[i].state;
+      bool inView = !focus || chunks.InView(i, focusChunk,
+                                            config.activeChunkRadius);
+      ChunkState next = chunks.Plan(i, inView, config.pageOutTicks);
+
+      if (state == ChunkState::PAGED_OUT && next != ChunkState::PAGED_OUT) {
+        LoadChunk(chunks.ChunkX(i), chunks.ChunkZ(i));
+      } else if (state != ChunkState::PAGED_OUT &&
+                 next == ChunkState::PAGED_OUT) {
+        UnloadChunk(chunks.ChunkX(i), chunks.ChunkZ(i));
+      }
+      chunks.SetState(i, next);
+    }
+  }
+
+  // Simulated time for something at position this tick: the frame time in an
+  // active chunk, the time since its last coarse step in a dormant chunk on
+  // its step tick, and zero otherwise. Dormant chunks are staggered so their
+  // steps do not all land on the same tick.
+  float SimulationStep(const Vector3 &position, float deltaTime) const {
+    std::size_t index = ChunkOf(position);
+    if (chunks[index].state == ChunkState::ACTIVE)
+      return deltaTime;
+
+    long interval = std::max(1, config.dormantTickInterval);
+    if ((tick + static_cast<long>(index)) % interval != 0)
+      return 0.0f;
+    return deltaTime * interval;
+  }
+
+  // Whether something at position is simulated at all this tick.
+  bool IsSimulated(const Vector3 &position) const {
+    return SimulationStep(position, 1.0f) > 0.0f;
+  }
+
+  void InitializeGame() {
+    points[Player::PLAYER1] = config.startingPoints;
+    points[Player::PLAYER2] = config.startingPoints;
+
+    for (uint32_t i = 0; i < map.ReactorCount(); i++) {
+      const MapObject &reactor = map.Reactors()[i];
+      Player team = static_cast<Player>(reactor.player);
+      EntityId entity =
+          CreateReactor(StandOnCell(reactor.x, reactor.z, 6.0f), team);
+      (team == Player::PLAYER1 ? player1Reactor : player2Reactor) = entity;
+    }
+
+    for (uint32_t i = 0; i < map.WallCount(); i++) {
+      const MapObject &wall = map.Walls()[i];
+      CreateWall(StandOnCell(wall.x, wall.z, 2.0f),
+                 static_cast<Player>(wall.player));
+    }
+  }
+
+  EntityId CreateWall(Vector3 position, Player owner) {
+    return SpawnBatch(scene, wallPrefabs[owner], {position}).front();
+  }
+
+  EntityId CreateAttacker(Vector3 position, Player owner) {
+    return SpawnBatch(scene, attackerPrefabs[owner], {position}).front();
+  }
+
+  std::vector<EntityId> SpawnAttackerWave(const std::vector<Vector3> &positions,
+                                          Player owner) {
+    return SpawnBatch(scene, attackerPrefabs[owner], positions);
+  }
+
+  EntityId CreateReactor(Vector3 position, Player team) {
+    return SpawnBatch(scene, reactorPrefabs[team], {position}).front();
+  }
+
+  EntityId CreatePortal(Vector3 position, Player team) {
+    return SpawnBatch(scene, portalPrefabs[team], {position}).front();
+  }
+
+  Vector3 SnapToGrid(const Vector3 &position) {
+    int x = round(position.x / tileSize);
+    int z = round(position.z / tileSize);
+    return {static_cast<float>(x * tileSize), position.y + 1.0f,
+            static_cast<float>(z * tileSize)};
+  }
+
+  bool IsValidSpawnPosition(const Vector3 &position) {
+    int x, z;
+    return WorldToCell(position, x, z);
+  }
+
+  // Inside the map and, when the map gives the owner spawn zones, inside one.
+  bool CanSpawnAt(Player owner, const Vector3 &position) {
+    int x, z;
+    if (!WorldToCell(position, x, z))
+      return false;
+
+    bool hasZone = false;
+    for (uint32_t i = 0; i < map.SpawnZoneCount(); i++) {
+      const MapSpawnZone &zone = map.SpawnZones()[i];
+      if (static_cast<Player>(zone.player) != owner)
+        continue;
+      if (zone.Contains(x, z))
+        return true;
+      hasZone = true;
+    }
+    return !hasZone;
+  }
+
+  // Safe to call from any thread and from command handlers, but not at the
+  // same time as the Flush in ApplyCommands; debug builds assert that.
+  // Commands submitted while ApplyCommands runs are applied by the next.
+  void Submit(const Command &command) { commands.Publish(command); }
+
+  // Applies the commands submitted since the last call, in submission order.
+  // A command the owner cannot afford, or whose target is not allowed, is
+  // dropped. Spawns are batched per prefab, so a thousand bot purchases cost
+  // a few scene updates rather than a thousand.
+  void ApplyCommands() {
+    commands.Flush();
+    for (const Command &command : commands.Events()) {
+      std::visit([this](const auto &c) { Apply(c); }, command);
+    }
+    commands.Clear();
+
+    for (Player owner : {Player::PLAYER1, Player::PLAYER2}) {
+      auto &attackers = attackerSpawns[static_cast<int>(owner)];
+      auto &walls = wallSpawns[static_cast<int>(owner)];
+      if (!attackers.empty()) {
+        SpawnBatch(scene, attackerPrefabs[owner], attackers);
+        attackers.clear();
+      }
+      if (!walls.empty()) {
+        SpawnBatch(scene, wallPrefabs[owner], walls);
+        walls.clear();
+      }
+    }
+  }
+
+  void Apply(const SpawnAttacker &command) {
+    if (!CanSpawnAt(command.owner, command.position) ||
+        points[command.owner] < config.attackerCost)
+      return;
+
+    attackerSpawns[static_cast<int>(command.owner)].push_back(
+        command.position);
+    points[command.owner] -= config.attackerCost;
+  }
+
+  void Apply(const SpawnWall &command) {
+    if (!CanSpawnAt(command.owner, command.position) ||
+        points[command.owner] < config.wallCost)
+      return;
+
+    wallSpawns[static_cast<int>(command.owner)].push_back(command.position);
+    points[command.owner] -= config.wallCost;
+  }
+
+  // Only the owner's units that are still around are moved.
+  void Apply(const PortalMove &command) {
+    if (!IsValidSpawnPosition(command.destination) ||
+        points[command.owner] < config.portalCost)
+      return;
+
+    bool moved = false;
+    for (auto entity : command.entities) {
+      auto playerComp = scene.ReadComponent<PlayerET>(entity);
+      if (!playerComp || playerComp->player != command.owner ||
+          scene.ReadComponent<TileET>(entity))
+        continue;
+      TeleportEntity(entity, command.destination);
+      moved = true;
+    }
+    if (moved) {
+      points[command.owner] -= config.portalCost;
+    }
+  }
+
+  // The owner's entities on the tile at position, or nothing when the owner
+  // cannot afford a portal.
+  std::vector<EntityId> SelectPortalEntities(Player owner,
+                                             const Vector3 &position) {
+    if (!IsValidSpawnPosition(position) || points[owner] < config.portalCost)
+      return {};
+
+    std::vector<EntityId> selected = GetEntitiesAtPosition(position);
+    selected.erase(std::remove_if(selected.begin(), selected.end(),
+                                  [this, owner](EntityId entity) {
+                                    auto playerComp =
+                                        scene.ReadComponent<PlayerET>(entity);
+                                    return !playerComp ||
+                                           playerComp->player != owner;
+                                  }),
+                   selected.end());
+    return selected;
+  }
+
+  uint32_t OpponentMask(Player owner) { return ALL_TEAMS & ~TeamBit(owner); }
+
+  // Teams that may target something of owner's at position: the opponents,
+  // and with the fog on only those that see it.
+  uint32_t TargetableBy(Player owner, const Vector3 &position) {
+    uint32_t mask = OpponentMask(owner);
+    int x, z;
+    if (config.fogOfWar && WorldToCell(position, x, z)) {
+      mask &= fog.VisibleMask(x, z);
+    }
+    return mask;
+  }
+
+  // Fills buffer with every alive, owned entity that passes keep, ready for
+  // the distance kernels. Each candidate's bits are the teams that may target
+  // it, so a search for owner's targets masks with TeamBit(owner).
+  template <typename Filter>
+  void GatherCandidates(PositionBuffer &buffer, Filter keep) {
+    buffer.Clear();
+    for (auto entity : scene.Query<PlayerET, TransformET, HealthET>()) {
+      auto playerComp = scene.ReadComponent<PlayerET>(entity);
+      auto transform = scene.ReadComponent<TransformET>(entity);
+      auto health = scene.ReadComponent<HealthET>(entity);
+
+      if (playerComp && transform && health && health->IsAlive() &&
+          keep(entity)) {
+        buffer.Push(entity, transform->position,
+                    TargetableBy(playerComp->player, transform->position));
+      }
+    }
+  }
+
+  // Attackers, walls and reactors; portals cannot be shot.
+  bool IsTargetable(EntityId entity) const {
+    return scene.ReadComponent<AttackerET>(entity) ||
+           scene.ReadComponent<DefenderET>(entity) ||
+           entity == player1Reactor || entity == player2Reactor;
+  }
+
+  EntityId FindNearestTarget(const Vector3 &position, Player owner) {
+    GatherCandidates(candidateBuffer, [this](EntityId entity) {
+      return scene.ReadComponent<AttackerET>(entity) ||
+             entity == player1Reactor || entity == player2Reactor;
+    });
+
+    std::ptrdiff_t nearest =
+        NearestIndex(candidateBuffer, position, TeamBit(owner));
+    return nearest < 0 ? -1 : candidateBuffer.entities[nearest];
+  }
+
+  EntityId FindNearestEnemy(const Vector3 &position, Player owner) {
+    GatherCandidates(candidateBuffer, [](EntityId) { return true; });
+
+    std::ptrdiff_t nearest =
+        NearestIndex(candidateBuffer, position, TeamBit(owner));
+    return nearest < 0 ? -1 : candidateBuffer.entities[nearest];
+  }
+
+  // Everything whose centre lies within the tile square around position.
+  std::vector<EntityId> GetEntitiesAtPosition(const Vector3 &position) {
+    candidateBuffer.Clear();
+    for (auto entity : scene.Query<TransformET>()) {
+      auto transform = scene.ReadComponent<TransformET>(entity);
+      candidateBuffer.Push(entity, transform->position, ALL_TEAMS);
+    }
+
+    candidateMask.resize(candidateBuffer.Size());
+    WithinSquare(candidateBuffer, position, tileSize / 2.0f, ALL_TEAMS,
+                 candidateMask.data());
+
+    std::vector<EntityId> entities;
+    for (std::size_t i = 0; i < candidateBuffer.Size(); i++) {
+      if (candidateMask[i]) {
+        entities.push_back(candidateBuffer.entities[i]);
+      }
+    }
+    return entities;
+  }
+
+  void TeleportEntity(EntityId entityId, const Vector3 &destination) {
+    auto transform = scene.GetComponent<TransformET>(entityId);
+    if (transform) {
+      Vector3 newPos = destination;
+      newPos.y = transform->position.y;
+      transform->position = newPos;
+    }
+  }
+
+  // One simulation tick. The steps are public so that the game can schedule
+  // them as separate systems; they have to run in this order.
+  void UpdateEntities(float deltaTime) {
+    ApplyCommands();
+    BeginTick();
+    UpdateCooldowns(deltaTime);
+    particleSystem.Update(deltaTime);
+    ResolveAttacks(deltaTime);
+    RemoveDead();
+  }
+
+  void BeginTick() {
+    tick++;
+    events.Clear();
+    UpdateStreaming();
+    UpdateFog();
+    UpdateWalls();
+  }
+
+  // The cell under position, clamped to the map.
+  void ClampedCell(const Vector3 &position, int &x, int &z) const {
+    WorldToCell(position, x, z);
+    x = std::clamp(x, 0, terrain.Width() - 1);
+    z = std::clamp(z, 0, terrain.Depth() - 1);
+  }
+
+  uint32_t CellIndex(const Vector3 &position) const {
+    int x, z;
+    ClampedCell(position, x, z);
+    return static_cast<uint32_t>(terrain.Index(x, z));
+  }
+
+  // Walls that were built or moved since the last pass now block sight
+  // lines. Walls that fall are dropped in RemoveDead.
+  void UpdateWalls() {
+    scene.QueryChanged<TransformET, DefenderET>(
+        wallsSeen, [this](EntityId wall) {
+          sight.PlaceWall(wall, CellIndex(scene.ReadComponent<TransformET>(
+                                    wall)->position));
+        });
+    wallsSeen = scene.AdvanceChangeTick();
+  }
+
+  // Restamps the units that spawned or moved since the last pass. Those in a
+  // chunk that is not simulated this tick wait for its next step. Units that
+  // die are dropped in RemoveDead.
+  void UpdateFog() {
+    std::size_t waiting = 0;
+    for (EntityId unit : fogDeferred) {
+      if (!Restamp(unit)) {
+        fogDeferred[waiting++] = unit;
+      }
+    }
+    fogDeferred.resize(waiting);
+
+    scene.QueryChanged<TransformET, PlayerET>(fogSeen, [this](EntityId unit) {
+      if (!Restamp(unit)) {
+        fogDeferred.push_back(unit);
+      }
+    });
+    fogSeen = scene.AdvanceChangeTick();
+  }
+
+  // Stamps the unit at its cell unless its chunk sleeps this tick. Returns
+  // false when it has to wait; a unit that is gone is done.
+  bool Restamp(EntityId unit) {
+    auto transform = scene.ReadComponent<TransformET>(unit);
+    if (!transform)
+      return true;
+    if (!IsSimulated(transform->position))
+      return false;
+    int x, z;
+    ClampedCell(transform->position, x, z);
+    fog.Place(unit, scene.ReadComponent<PlayerET>(unit)->player, x, z);
+    return true;
+  }
+
+  // Whether owner's team sees the cell under position; everything is visible
+  // with the fog off.
+  bool IsVisibleTo(Player owner, const Vector3 &position) const {
+    int x, z;
+    return !config.fogOfWar || !WorldToCell(position, x, z) ||
+           fog.IsVisible(owner, x, z);
+  }
+
+  // Ticks down the cooldowns of the attackers simulated this tick and
+  // remembers them for ResolveAttacks.
+  void UpdateCooldowns(float deltaTime) {
+    simulated.clear();
+    for (auto entity : scene.Query<AttackerET, TransformET>()) {
+      auto attacker = scene.ReadComponent<AttackerET>(entity);
+      auto transform = scene.ReadComponent<TransformET>(entity);
+      float step = SimulationStep(transform->position, deltaTime);
+      if (step == 0.0f)
+        continue;
+      if (attacker->currentCooldown > 0) {
+        scene.GetComponent<AttackerET>(entity)->currentCooldown -= step;
+      }
+      simulated.push_back(entity);
+    }
+  }
+
+  // Index in candidateBuffer of the target an attacker of owner's at position
+  // goes for, or -1. Without line of sight that is the nearest target at any
+  // range and the caller checks the range. With it, it is the nearest target
+  // within range that is in sight; rays are traced in batches of
+  // SIGHT_BATCH, nearest first, until one is clear.
+  std::ptrdiff_t AcquireTarget(const Vector3 &position, Player owner,
+                               float range, float *outDistSq) {
+    if (!config.lineOfSight)
+      return NearestIndex(candidateBuffer, position, TeamBit(owner),
+                          outDistSq);
+
+    candidateMask.resize(candidateBuffer.Size());
+    WithinRadius(candidateBuffer, position, range, TeamBit(owner),
+                 candidateMask.data());
+
+    inRange.clear();
+    for (std::size_t i = 0; i < candidateBuffer.Size(); i++) {
+      if (!candidateMask[i])
+        continue;
+      float dx = candidateBuffer.x[i] - position.x;
+      float dy = candidateBuffer.y[i] - position.y;
+      float dz = candidateBuffer.z[i] - position.z;
+      inRange.push_back({dx * dx + dy * dy + dz * dz, i});
+    }
+    std::sort(inRange.begin(), inRange.end());
+
+    const std::size_t SIGHT_BATCH = 8;
+    uint32_t from = CellIndex(position);
+    for (std::size_t start = 0; start < inRange.size(); start += SIGHT_BATCH) {
+      std::size_t count = std::min(SIGHT_BATCH, inRange.size() - start);
+      sightRays.resize(count);
+      sightResults.resize(count);
+      for (std::size_t k = 0; k < count; k++) {
+        std::size_t i = inRange[start + k].second;
+        sightRays[k] = {from, CellIndex({candidateBuffer.x[i], 0.0f,
+                                         candidateBuffer.z[i]})};
+      }
+      sight.Check(sightRays.data(), count, sightResults.data());
+
+      for (std::size_t k = 0; k < count; k++) {
+        if (sightResults[k]) {
+          *outDistSq = inRange[start + k].first;
+          return static_cast<std::ptrdiff_t>(inRange[start + k].second);
+        }
+      }
+    }
+    return -1;
+  }
+
+  // Each attacker whose cooldown is up fires at its target, chosen from the
+  // units alive when the tick began.
+  void FireAttacks() {
+    GatherCandidates(candidateBuffer,
+                     [this](EntityId entity) { return IsTargetable(entity); });
+
+    for (auto entity : simulated) {
+      auto attacker = scene.ReadComponent<AttackerET>(entity);
+      auto transform = scene.ReadComponent<TransformET>(entity);
+      auto playerComp = scene.ReadComponent<PlayerET>(entity);
+      auto health = scene.ReadComponent<HealthET>(entity);
+
+      if (!attacker || !transform || !playerComp || !health ||
+          !health->IsAlive() || !attacker->CanAttack()) {
+        continue;
+      }
+
+      float distanceSq = INFINITY;
+      std::ptrdiff_t nearest =
+          AcquireTarget(transform->position, playerComp->player,
+                        attacker->range, &distanceSq);
+      if (nearest < 0 || distanceSq > attacker->range * attacker->range)
+        continue;
+
+      scene.GetComponent<AttackerET>(entity)->Attack();
+      lastAttackTick = tick;
+      events.Publish(ProjectileFiredEvent{
+          entity, candidateBuffer.entities[nearest], playerComp->player,
+          attacker->damage});
+    }
+    events.Flush<ProjectileFiredEvent>();
+  }
+
+  // Launches this tick's shots and moves the projectiles in flight by their
+  // chunk's SimulationStep, or with projectiles off lands the shots straight
+  // away. Nothing is gathered while every projectile sleeps.
+  void UpdateProjectiles(float deltaTime) {
+    const auto &fired = events.Events<ProjectileFiredEvent>();
+    if (!config.projectiles) {
+      for (const auto &shot : fired) {
+        events.Publish(ProjectileHitEvent{shot.shooter, shot.target, shot.team,
+                                          shot.damage});
+      }
+      events.Flush<ProjectileHitEvent>();
+      return;
+    }
+
+    for (const auto &shot : fired) {
+      Vector3 start = scene.ReadComponent<TransformET>(shot.shooter)->position;
+      Vector3 aim = scene.ReadComponent<TransformET>(shot.target)->position;
+      start.y += 1.0f;
+      aim.y += 1.0f;
+      // A shot that cannot fly, with no positive projectileSpeed, lands
+      // straight away like with projectiles off.
+      if (!projectiles.Launch(shot.shooter, shot.team, TeamBit(shot.team),
+                              start, aim, config.projectileSpeed,
+                              shot.damage)) {
+        events.Publish(ProjectileHitEvent{shot.shooter, shot.target,
+                                          shot.team, shot.damage});
+      }
+    }
+
+    projectileSteps.resize(projectiles.Size());
+    bool moving = false;
+    for (std::size_t i = 0; i < projectiles.Size(); i++) {
+      projectileSteps[i] = SimulationStep(projectiles.Position(i), deltaTime);
+      moving |= projectileSteps[i] > 0.0f;
+    }
+    if (!moving) {
+      events.Flush<ProjectileHitEvent>();
+      return;
+    }
+
+    hittable.Clear();
+    for (auto entity : scene.Query<PlayerET, TransformET, HealthET>()) {
+      auto health = scene.ReadComponent<HealthET>(entity);
+      if (health->IsAlive() && IsTargetable(entity)) {
+        Player owner = scene.ReadComponent<PlayerET>(entity)->player;
+        Vector3 position = scene.ReadComponent<TransformET>(entity)->position;
+        hittable.Push(entity, position, OpponentMask(owner));
+      }
+    }
+
+    projectileHits.clear();
+    projectiles.Step(projectileSteps, hittable, projectileHits);
+    for (const auto &hit : projectileHits) {
+      events.Publish(
+          ProjectileHitEvent{hit.shooter, hit.target, hit.team, hit.damage});
+    }
+    events.Flush<ProjectileHitEvent>();
+  }
+
+  // Lands this tick's hits in order. Walls may block part of the damage;
+  // hits on targets that are already dead are lost.
+  void ApplyDamage() {
+    std::uniform_int_distribution<int> blockRoll(0, 100);
+    for (const auto &shot : events.Events<ProjectileHitEvent>()) {
+      auto targetHealth = scene.ReadComponent<HealthET>(shot.target);
+      if (!targetHealth || !targetHealth->IsAlive())
+        continue;
+
+      float dealt = shot.damage;
+      if (auto targetDefense = scene.ReadComponent<DefenderET>(shot.target)) {
+        dealt = targetDefense->CalculateDamageReduction(shot.damage,
+                                                        blockRoll(rng));
+      }
+      scene.GetComponent<HealthET>(shot.target)->TakeDamage(dealt);
+      events.Publish(DamageEvent{shot.shooter, shot.target, shot.team,
+                                 shot.damage, dealt});
+      if (!targetHealth->IsAlive()) {
+        events.Publish(DeathEvent{shot.target, shot.team, dealt});
+      }
+    }
+    events.Flush<DamageEvent>();
+    events.Flush<DeathEvent>();
+  }
+
+  // A tracer per landed shot, dimmed by how much of it was blocked. Real
+  // projectiles are drawn themselves.
+  void EmitAttackParticles() {
+    if (!config.cosmetics || config.projectiles)
+      return;
+    for (const auto &hit : events.Events<DamageEvent>()) {
+      auto source = scene.ReadComponent<TransformET>(hit.source);
+      auto target = scene.ReadComponent<TransformET>(hit.target);
+      if (!source || !target)
+        continue;
+
+      Color particleColor;
+      if (hit.team == Player::PLAYER1) {
+        particleColor = Color{0, 120, 255, 255};
+      } else {
+        particleColor = Color{255, 60, 60, 255};
+      }
+
+      Vector3 startPos = source->position;
+      Vector3 endPos = target->position;
+      startPos.y += 1.0f;
+      endPos.y += 1.0f;
+
+      float damageReductionFactor = hit.dealt / hit.damage;
+      Color modifiedParticleColor = {
+          static_cast<unsigned char>(particleColor.r * damageReductionFactor),
+          static_cast<unsigned char>(particleColor.g * damageReductionFactor),
+          particleColor.b, particleColor.a};
+
+      particleSystem.AddParticle<AttackParticle>(
+          startPos, endPos, modifiedParticleColor, 4.0f);
+    }
+  }
+
+  void ScoreKills() {
+    for (const auto &death : events.Events<DeathEvent>()) {
+      points[death.killer] += death.dealt > 0 ? 50 : 25;
+    }
+  }
+
+  void ResolveAttacks(float deltaTime) {
+    FireAttacks();
+    UpdateProjectiles(deltaTime);
+    ApplyDamage();
+    EmitAttackParticles();
+    ScoreKills();
+  }
+
+  // Removes everything that died this tick except the reactors, which
+  // GetWinner still needs.
+  void RemoveDead() {
+    fallen.clear();
+    for (const auto &death : events.Events<DeathEvent>()) {
+      EntityId entity = death.entity;
+      if (entity != player1Reactor && entity != player2Reactor) {
+        ForgetUnit(entity);
+        fog.Remove(entity);
+        sight.RemoveWall(entity);
+        fallen.push_back(entity);
+      }
+    }
+    if (!fallen.empty()) {
+      scene.RemoveEntities(fallen);
+    }
+  }
+
+  std::optional<Player> GetWinner() {
+    auto reactor1 = scene.ReadComponent<HealthET>(player1Reactor);
+    auto reactor2 = scene.ReadComponent<HealthET>(player2Reactor);
+
+    if (reactor1 && reactor2) {
+      if (!reactor1->IsAlive())
+        return Player::PLAYER2;
+      if (!reactor2->IsAlive())
+        return Player::PLAYER1;
+    }
+    return std::nullopt;
+  }
+};
@@ -0,0 +1,254 @@
+#pragma once
+#include <array>
+#include <condition_variable>
+#include <cstddef>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// What a system touches. Entries are component types or tag types for other
+// shared state, such as SceneStructure.
+template <typename... Ts> struct Reads {};
+template <typename... Ts> struct Writes {};
+
+// Creating or removing entities and components. Every system that iterates
+// the scene reads it; every system that spawns or despawns writes it.
+struct SceneStructure {};
+
+namespace pipeline {
+
+template <typename T, typename List> struct Contains;
+template <typename T, template <typename...> class List, typename... Ts>
+struct Contains<T, List<Ts...>>
+    : std::bool_constant<(std::is_same_v<T, Ts> || ...)> {};
+
+template <typename A, typename B> struct Overlaps;
+template <template <typename...> class List, typename... As, typename B>
+struct Overlaps<List<As...>, B>
+    : std::bool_constant<(Contains<As, B>::value || ...)> {};
+
+// Two systems conflict when either writes something the other reads or
+// writes.
+template <typename A, typename B>
+constexpr bool Conflicts =
+    Overlaps<typename A::writes, typename B::writes>::value ||
+    Overlaps<typename A::writes, typename B::reads>::value ||
+    Overlaps<typename B::writes, typename A::reads>::value;
+
+// conflicts[a * N + b] for every pair of systems in the tuple.
+template <typename Tuple, std::size_t... I>
+constexpr std::array<bool, sizeof...(I)>
+ConflictMatrix(std::index_sequence<I...>) {
+  constexpr std::size_t count = std::tuple_size_v<Tuple>;
+  return {Conflicts<std::tuple_element_t<I / count, Tuple>,
+                    std::tuple_element_t<I % count, Tuple>>...};
+}
+
+// A system's stage is one past the latest stage of the earlier systems it
+// conflicts with.
+template <typename... Systems>
+constexpr std::array<std::size_t, sizeof...(Systems)> Stages() {
+  constexpr std::size_t count = sizeof...(Systems);
+  constexpr auto conflicts = ConflictMatrix<std::tuple<Systems...>>(
+      std::make_index_sequence<count * count>());
+  std::array<std::size_t, count> stage = {};
+  for (std::size_t later = 0; later < count; later++) {
+    for (std::size_t earlier = 0; earlier < later; earlier++) {
+      if (conflicts[earlier * count + later] &&
+          stage[later] <= stage[earlier]) {
+        stage[later] = stage[earlier] + 1;
+      }
+    }
+  }
+  return stage;
+}
+
+template <std::size_t N>
+constexpr std::size_t StageCount(const std::array<std::size_t, N> &stages) {
+  std::size_t count = 0;
+  for (std::size_t stage : stages) {
+    count = stage + 1 > count ? stage + 1 : count;
+  }
+  return count;
+}
+
+template <std::size_t N>
+constexpr std::array<std::size_t, N>
+FirstInStage(const std::array<std::size_t, N> &stages) {
+  std::array<std::size_t, N> first = {};
+  for (std::size_t i = N; i-- > 0;) {
+    first[stages[i]] = i;
+  }
+  return first;
+}
+
+// The most systems any one stage runs at the same time.
+template <std::size_t N>
+constexpr std::size_t WidestStage(const std::array<std::size_t, N> &stages) {
+  std::size_t widest = 0;
+  for (std::size_t stage : stages) {
+    std::size_t width = 0;
+    for (std::size_t other : stages) {
+      width += other == stage;
+    }
+    widest = width > widest ? width : widest;
+  }
+  return widest;
+}
+
+// Threads that live as long as the pool and run the tasks submitted to it,
+// so that running systems side by side does not start a thread every frame.
+class WorkerPool {
+private:
+  std::mutex mutex;
+  std::condition_variable wake;
+  std::condition_variable idle;
+  // Kept between stages, so submitting does not allocate once it has grown.
+  std::vector<std::function<void()>> queue;
+  std::size_t busy = 0;
+  std::exception_ptr failure;
+  bool stopping = false;
+  std::vector<std::thread> threads;
+
+  void Work() {
+    std::unique_lock<std::mutex> lock(mutex);
+    for (;;) {
+      wake.wait(lock, [this]() { return stopping || !queue.empty(); });
+      if (queue.empty())
+        return;
+      std::function<void()> task = std::move(queue.back());
+      queue.pop_back();
+      busy++;
+
+      lock.unlock();
+      std::exception_ptr error;
+      try {
+        task();
+      } catch (...) {
+        error = std::current_exception();
+      }
+      lock.lock();
+
+      if (error && !failure)
+        failure = error;
+      if (--busy == 0 && queue.empty())
+        idle.notify_all();
+    }
+  }
+
+public:
+  explicit WorkerPool(std::size_t count) {
+    for (std::size_t i = 0; i < count; i++) {
+      threads.emplace_back([this]() { Work(); });
+    }
+  }
+
+  WorkerPool(const WorkerPool &) = delete;
+  WorkerPool &operator=(const WorkerPool &) = delete;
+
+  ~WorkerPool() {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      stopping = true;
+    }
+    wake.notify_all();
+    for (auto &thread : threads) {
+      thread.join();
+    }
+  }
+
+  std::size_t Size() const { return threads.size(); }
+
+  void Submit(std::function<void()> task) {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      queue.push_back(std::move(task));
+    }
+    wake.notify_one();
+  }
+
+  // Blocks until every submitted task has finished, then rethrows the first
+  // exception one of them threw.
+  void Wait() {
+    std::unique_lock<std::mutex> lock(mutex);
+    idle.wait(lock, [this]() { return queue.empty() && busy == 0; });
+    if (failure) {
+      std::exception_ptr error = failure;
+      failure = nullptr;
+      std::rethrow_exception(error);
+    }
+  }
+};
+
+} // namespace pipeline
+
+// Runs systems in declaration order, except that systems which do not
+// conflict may run at the same time. A system is a default-constructible type
+// with `reads` and `writes` lists and a Run(Context &) member.
+//
+// The dependency graph has an edge from every system to each later system it
+// conflicts with, and is resolved at compile time into stages. Stages run one
+// after another; within a stage the first system runs on the calling thread
+// and the others on a pool of one thread less than the widest stage has
+// systems, started with the pipeline. A pipeline without such a stage
+// starts no threads and runs everything inline.
+template <typename... Systems> class Pipeline {
+public:
+  static constexpr std::array<std::size_t, sizeof...(Systems)> stages =
+      pipeline::Stages<Systems...>();
+  static constexpr std::size_t stageCount = pipeline::StageCount(stages);
+
+private:
+  static constexpr std::array<std::size_t, sizeof...(Systems)> firstInStage =
+      pipeline::FirstInStage(stages);
+
+  using SystemTuple = std::tuple<Systems...>;
+  SystemTuple systems;
+  static constexpr std::size_t widestStage = pipeline::WidestStage(stages);
+  pipeline::WorkerPool workers{widestStage > 1 ? widestStage - 1 : 0};
+
+  template <std::size_t I, typename Context>
+  void Launch(std::size_t stage, Context &context) {
+    if (stages[I] != stage || firstInStage[stage] == I)
+      return;
+    auto &system = std::get<I>(systems);
+    workers.Submit([&system, &context]() { system.Run(context); });
+  }
+
+  template <std::size_t I, typename Context>
+  void RunInline(std::size_t stage, Context &context) {
+    if (stages[I] == stage && firstInStage[stage] == I) {
+      std::get<I>(systems).Run(context);
+    }
+  }
+
+  template <typename Context, std::size_t... I>
+  void RunStage(std::size_t stage, Context &context,
+                std::index_sequence<I...>) {
+    (Launch<I>(stage, context), ...);
+    // The workers still use context, so they finish even if this throws.
+    std::exception_ptr error;
+    try {
+      (RunInline<I>(stage, context), ...);
+    } catch (...) {
+      error = std::current_exception();
+    }
+    workers.Wait();
+    if (error)
+      std::rethrow_exception(error);
+  }
+
+public:
+  std::size_t WorkerCount() const { return workers.Size(); }
+
+  template <typename Context> void Run(Context &context) {
+    for (std::size_t stage = 0; stage < stageCount; stage++) {
+      RunStage(stage, context, std::index_sequence_for<Systems...>());
+    }
+  }
+};
@@ -0,0 +1,42 @@
+#pragma once
+#include "ECS.hpp"
+#include "entity-components/Transform.hpp"
+#include <functional>
+
+// A declarative entity template: the component set and its default values.
+// Transforms are per-instance and come from the spawn positions.
+class Prefab {
+private:
+  std::vector<std::function<void(Scene &, const std::vector<EntityId> &)>>
+      builders;
+
+public:
+  template <typename T, typename... Args> Prefab &With(Args &&...args) {
+    T component(std::forward<Args>(args)...);
+    builders.push_back(
+        [component](Scene &scene, const std::vector<EntityId> &batch) {
+          scene.AssignBatch<T>(batch, component);
+        });
+    return *this;
+  }
+
+  std::size_t ComponentCount() const { return builders.size(); }
+
+  void Build(Scene &scene, const std::vector<EntityId> &batch) const {
+    for (const auto &builder : builders) {
+      builder(scene, batch);
+    }
+  }
+};
+
+inline std::vector<EntityId> SpawnBatch(Scene &scene, const Prefab &prefab,
+                                        const std::vector<Vector3> &positions) {
+  std::vector<EntityId> batch =
+      scene.NewEntities(positions.size(), prefab.ComponentCount() + 1);
+
+  scene.AssignBatch<TransformET>(
+      batch, std::vector<TransformET>(positions.begin(), positions.end()));
+  prefab.Build(scene, batch);
+
+  return batch;
+}
@@ -0,0 +1,331 @@
+#pragma once
+#include "DistanceKernels.hpp"
+#include "ECS.hpp"
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+// Shots in flight, stored as structure-of-arrays so moving them is one tight
+// loop per axis. A projectile flies at constant velocity towards the point it
+// was aimed at and hits the first unit of a team in its hitMask that its path
+// passes within hitRadius of, in the ground plane. One that reaches its aim
+// point without hitting anything is dropped.
+//
+// Collisions are resolved for all projectiles at once against a grid of the
+// units bucketed by map cell, rebuilt every step from the cells the units
+// occupy, so the empty rest of the map costs a step nothing. A projectile
+// only looks at the cells around where it ended a move, so Step splits its
+// time into moves of at most cellSize - hitRadius in the ground plane.
+class ProjectilePool {
+public:
+  struct Hit {
+    EntityId shooter;
+    EntityId target;
+    Player team;
+    float damage;
+  };
+
+private:
+  std::vector<float> x, y, z;
+  std::vector<float> vx, vy, vz;
+  std::vector<float> timeLeft;
+  // How long the projectile moves per move of the current step.
+  std::vector<float> moveTime;
+  std::vector<float> damage;
+  std::vector<uint32_t> hitMask;
+  std::vector<Player> team;
+  std::vector<EntityId> shooter;
+
+  int width = 0;
+  int depth = 0;
+  float cellSize = 1.0f;
+  float inverseCellSize = 1.0f;
+  float hitRadius = 0.5f;
+  // Longest ground distance one move may cover and still have every unit its
+  // path passes within hitRadius of in the 3x3 cells around its end.
+  float moveReach = 0.5f;
+  // Units of cell c are the cellCount[c] entries of cellUnits from
+  // cellFirst[c], as indices into the buffer passed to Step. cellFirst is
+  // stale where cellCount is zero.
+  std::vector<uint32_t> cellFirst;
+  std::vector<uint32_t> cellCount;
+  std::vector<uint32_t> cellUnits;
+  std::vector<uint32_t> unitCells;
+  // Cells holding a unit, in the order the last BuildGrid met them; only
+  // they and their neighbours need clearing for the next one.
+  std::vector<uint32_t> occupied;
+  // Team bits of every unit in each cell or its eight neighbours, so most
+  // projectiles are done with one lookup. Teams fit in a byte.
+  std::vector<uint8_t> nearBits;
+  // Projectiles that hit or arrived during the current move, ascending.
+  std::vector<std::size_t> done;
+
+  std::size_t CellOf(float worldX, float worldZ) const {
+    int cellX =
+        static_cast<int>(std::floor(worldX * inverseCellSize + 0.5f)) +
+        width / 2;
+    int cellZ =
+        static_cast<int>(std::floor(worldZ * inverseCellSize + 0.5f)) +
+        depth / 2;
+    cellX = cellX < 0 ? 0 : cellX >= width ? width - 1 : cellX;
+    cellZ = cellZ < 0 ? 0 : cellZ >= depth ? depth - 1 : cellZ;
+    return std::size_t(cellZ) * width + cellX;
+  }
+
+  // Calls visit with the nearBits of the cell and each of its neighbours.
+  template <typename Visit> void ForEachNear(std::size_t cell, Visit visit) {
+    int cellX = static_cast<int>(cell % width);
+    int cellZ = static_cast<int>(cell / width);
+    for (int z = std::max(cellZ - 1, 0); z <= std::min(cellZ + 1, depth - 1);
+         z++) {
+      for (int x = std::max(cellX - 1, 0); x <= std::min(cellX + 1, width - 1);
+           x++) {
+        visit(nearBits[std::size_t(z) * width + x]);
+      }
+    }
+  }
+
+  void BuildGrid(const PositionBuffer &units) {
+    for (uint32_t cell : occupied) {
+      cellCount[cell] = 0;
+      ForEachNear(cell, [](uint8_t &near) { near = 0; });
+    }
+    occupied.clear();
+
+    unitCells.resize(units.Size());
+    for (std::size_t i = 0; i < units.Size(); i++) {
+      std::size_t cell = CellOf(units.x[i], units.z[i]);
+      unitCells[i] = static_cast<uint32_t>(cell);
+      if (cellCount[cell]++ == 0) {
+        occupied.push_back(static_cast<uint32_t>(cell));
+      }
+      uint8_t bits = static_cast<uint8_t>(units.teamBits[i]);
+      ForEachNear(cell, [bits](uint8_t &near) { near |= bits; });
+    }
+    // Each cell's first is set one past its slice, and filling from the last
+    // unit back leaves it at the start with the units ascending.
+    uint32_t end = 0;
+    for (uint32_t cell : occupied) {
+      end += cellCount[cell];
+      cellFirst[cell] = end;
+    }
+    cellUnits.resize(units.Size());
+    for (std::size_t i = units.Size(); i-- > 0;) {
+      cellUnits[--cellFirst[unitCells[i]]] = static_cast<uint32_t>(i);
+    }
+  }
+
+  // The unit the path of projectile i over the last move hits first, or -1.
+  std::ptrdiff_t FirstHit(std::size_t i, const PositionBuffer &units,
+                          float deltaTime) const {
+    float startX = x[i] - vx[i] * deltaTime;
+    float startZ = z[i] - vz[i] * deltaTime;
+    float pathX = x[i] - startX;
+    float pathZ = z[i] - startZ;
+    float pathLengthSq = pathX * pathX + pathZ * pathZ;
+
+    std::size_t center = CellOf(x[i], z[i]);
+    int centerX = static_cast<int>(center % width);
+    int centerZ = static_cast<int>(center / width);
+    std::ptrdiff_t best = -1;
+    float bestAlong = INFINITY;
+    for (int cellZ = centerZ - 1; cellZ <= centerZ + 1; cellZ++) {
+      for (int cellX = centerX - 1; cellX <= centerX + 1; cellX++) {
+        if (cellX < 0 || cellX >= width || cellZ < 0 || cellZ >= depth)
+          continue;
+        std::size_t cell = std::size_t(cellZ) * width + cellX;
+        uint32_t first = cellFirst[cell];
+        for (uint32_t k = first; k < first + cellCount[cell]; k++) {
+          uint32_t unit = cellUnits[k];
+          if (!(units.teamBits[unit] & hitMask[i]))
+            continue;
+
+          // Closest point of the path to the unit.
+          float toX = units.x[unit] - startX;
+          float toZ = units.z[unit] - startZ;
+          float along = pathLengthSq > 0.0f
+                            ? (toX * pathX + toZ * pathZ) / pathLengthSq
+                            : 0.0f;
+          along = along < 0.0f ? 0.0f : along > 1.0f ? 1.0f : along;
+          float dx = toX - pathX * along;
+          float dz = toZ - pathZ * along;
+          if (dx * dx + dz * dz <= hitRadius * hitRadius &&
+              along < bestAlong) {
+            bestAlong = along;
+            best = unit;
+          }
+        }
+      }
+    }
+    return best;
+  }
+
+  // Moves the last projectile into slot i.
+  void RemoveAt(std::size_t i) {
+    for (auto *column : {&x, &y, &z, &vx, &vy, &vz, &timeLeft, &moveTime,
+                       &damage}) {
+      (*column)[i] = column->back();
+      column->pop_back();
+    }
+    hitMask[i] = hitMask.back();
+    hitMask.pop_back();
+    team[i] = team.back();
+    team.pop_back();
+    shooter[i] = shooter.back();
+    shooter.pop_back();
+  }
+
+  // Moves every projectile by its moveTime, which must keep it within
+  // moveReach, and resolves what its path hit. Projectiles without one stay
+  // put. A move never takes one past its aim point: the last is cut short
+  // there, and as the projectile is dropped after it, so is its moveTime.
+  void Move(const PositionBuffer &units, std::vector<Hit> &hits) {
+    std::size_t count = x.size();
+    for (std::size_t i = 0; i < count; i++) {
+      float t = std::min(moveTime[i], timeLeft[i]);
+      moveTime[i] = t;
+      x[i] += vx[i] * t;
+      y[i] += vy[i] * t;
+      z[i] += vz[i] * t;
+      timeLeft[i] -= t;
+    }
+
+    done.clear();
+    for (std::size_t i = 0; i < count; i++) {
+      if (moveTime[i] == 0.0f && timeLeft[i] > 0.0f)
+        continue;
+      std::ptrdiff_t unit = -1;
+      if (nearBits[CellOf(x[i], z[i])] & hitMask[i]) {
+        unit = FirstHit(i, units, moveTime[i]);
+      }
+      if (unit >= 0) {
+        hits.push_back({shooter[i], units.entities[unit], team[i], damage[i]});
+      }
+      if (unit >= 0 || timeLeft[i] <= 0.0f) {
+        done.push_back(i);
+      }
+    }
+
+    // From the back, so every projectile moved into a freed slot is one
+    // that stays.
+    for (std::size_t k = done.size(); k-- > 0;) {
+      RemoveAt(done[k]);
+    }
+  }
+
+public:
+  // A map of width * depth cells of cellSize, centred on the origin like the
+  // match's. radius has to be under size.
+  void Reset(int mapWidth, int mapDepth, float size, float radius) {
+    assert(radius >= 0.0f && radius < size && "hit radius under a cell");
+    width = mapWidth;
+    depth = mapDepth;
+    cellSize = size;
+    inverseCellSize = 1.0f / size;
+    hitRadius = radius;
+    moveReach = size - radius;
+    cellFirst.assign(std::size_t(width) * depth, 0);
+    cellCount.assign(std::size_t(width) * depth, 0);
+    occupied.clear();
+    nearBits.assign(std::size_t(width) * depth, 0);
+    for (auto *column : {&x, &y, &z, &vx, &vy, &vz, &timeLeft, &moveTime,
+                       &damage}) {
+      column->clear();
+    }
+    hitMask.clear();
+    team.clear();
+    shooter.clear();
+  }
+
+  std::size_t Size() const { return x.size(); }
+  Vector3 Position(std::size_t i) const { return {x[i], y[i], z[i]}; }
+  Player Team(std::size_t i) const { return team[i]; }
+
+  // Returns false, launching nothing, unless speed is positive and finite.
+  bool Launch(EntityId from, Player owner, uint32_t mask, Vector3 start,
+              Vector3 aim, float speed, float shotDamage) {
+    if (!(speed > 0.0f) || !std::isfinite(speed))
+      return false;
+    Vector3 path = {aim.x - start.x, aim.y - start.y, aim.z - start.z};
+    float length =
+        std::sqrt(path.x * path.x + path.y * path.y + path.z * path.z);
+    float scale = length > 0.0f ? speed / length : 0.0f;
+    x.push_back(start.x);
+    y.push_back(start.y);
+    z.push_back(start.z);
+    vx.push_back(path.x * scale);
+    vy.push_back(path.y * scale);
+    vz.push_back(path.z * scale);
+    timeLeft.push_back(length / speed);
+    moveTime.push_back(0.0f);
+    damage.push_back(shotDamage);
+    hitMask.push_back(mask);
+    team.push_back(owner);
+    shooter.push_back(from);
+    return true;
+  }
+
+  // Moves every projectile by deltaTime and appends what hit something to
+  // hits, move by move and by pool index within a move, which is not
+  // necessarily the order they hit in. Those and the ones that arrived are
+  // removed.
+  // units are tagged with the teams whose shots hit them and stay put for the
+  // whole step.
+  void Step(float deltaTime, const PositionBuffer &units,
+            std::vector<Hit> &hits) {
+    Step(std::vector<float>(x.size(), deltaTime), units, hits);
+  }
+
+  // Like Step above, but projectile i moves by deltaTimes[i], which may be
+  // zero to leave it where it is.
+  void Step(const std::vector<float> &deltaTimes, const PositionBuffer &units,
+            std::vector<Hit> &hits) {
+    assert(deltaTimes.size() == x.size());
+    if (x.empty())
+      return;
+
+    // Past the longest remaining flight every projectile has arrived, so a
+    // long frame costs no more moves than the flight itself.
+    float longest = 0.0f;
+    bool moving = false;
+    for (std::size_t i = 0; i < x.size(); i++) {
+      longest = std::max(longest, timeLeft[i]);
+      moving |= deltaTimes[i] > 0.0f;
+    }
+    if (!moving)
+      return;
+    float longestReach = 0.0f;
+    for (std::size_t i = 0; i < x.size(); i++) {
+      moveTime[i] = std::min(deltaTimes[i], longest);
+      float speed = std::sqrt(vx[i] * vx[i] + vz[i] * vz[i]);
+      longestReach = std::max(longestReach, speed * moveTime[i]);
+    }
+    int moves = std::max(
+        1, static_cast<int>(std::ceil(longestReach / moveReach)));
+    for (float &time : moveTime) {
+      time /= moves;
+    }
+
+    BuildGrid(units);
+    for (int move = 0; move < moves && !x.empty(); move++) {
+      Move(units, hits);
+    }
+  }
+
+  MemoryEntry GetMemoryEntry() const {
+    MemoryEntry entry;
+    entry.name = "Match.projectiles";
+    entry.count = x.size();
+    entry.elementBytes = 9 * sizeof(float) + sizeof(uint32_t) +
+                         sizeof(Player) + sizeof(EntityId);
+    entry.capacityBytes = x.capacity() * entry.elementBytes +
+                          (cellFirst.capacity() + cellCount.capacity() +
+                           cellUnits.capacity() + unitCells.capacity() +
+                           occupied.capacity()) *
+                              sizeof(uint32_t) +
+                          nearBits.capacity();
+    return entry;
+  }
+};
@@ -0,0 +1,227 @@
+#pragma once
+#include "Match.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Spectator messages are per chunk and little-endian:
+//
+//   u8 type, u32 tick, u32 chunk, u32 units, u32 removed
+//   units   * { u32 id, u8 team, u8 kind, f32 x, f32 z, f32 health }
+//   removed * { u32 id }
+//
+// A keyframe lists every unit in the chunk and replaces what the spectator
+// had for it. A delta lists the units that spawned, moved or were hurt since
+// the previous tick and the ones that died or left the chunk. A reset, with
+// chunk and counts zero, drops everything the spectator had; it comes before
+// the keyframes a spectator starts or resyncs with, since chunks without
+// units get no keyframe.
+enum class SpectatorMessage : uint8_t { DELTA, KEYFRAME, RESET };
+enum class SpectatorUnit : uint8_t { OTHER, ATTACKER, WALL, PORTAL };
+
+// Encoded once per tick. Whoever sends it may move the bytes out, so that
+// all spectators share them without a copy.
+using SpectatorPayload = std::shared_ptr<std::string>;
+
+struct SpectatorFrame {
+  long tick = 0;
+  uint32_t chunksX = 0;
+  // Indexed by chunk; null where nothing changed.
+  std::vector<SpectatorPayload> deltas;
+  // On keyframe ticks one per chunk, null where the chunk holds no units,
+  // and the reset that goes before them. Empty and null otherwise.
+  std::vector<SpectatorPayload> keyframes;
+  SpectatorPayload reset;
+};
+
+// Turns each tick of a match into a SpectatorFrame. Encode has to run after
+// every tick, since deaths are only known for the last one.
+class SpectatorEncoder {
+private:
+  struct ChunkChanges {
+    std::vector<EntityId> units;
+    std::vector<EntityId> removed;
+  };
+
+  int keyframeInterval;
+  uint32_t seen = 0;
+  // Chunk each unit was last reported in.
+  std::unordered_map<EntityId, std::size_t> unitChunks;
+  std::vector<ChunkChanges> changes;
+  // Units that moved or were hurt since the last frame, ascending.
+  std::vector<EntityId> changed;
+
+  template <typename T> static void Put(std::string &out, T value) {
+    char bytes[sizeof(T)];
+    std::memcpy(bytes, &value, sizeof(T));
+    out.append(bytes, sizeof(T));
+  }
+
+  static SpectatorUnit KindOf(Scene &scene, EntityId unit) {
+    if (scene.ReadComponent<AttackerET>(unit))
+      return SpectatorUnit::ATTACKER;
+    if (scene.ReadComponent<DefenderET>(unit))
+      return SpectatorUnit::WALL;
+    if (scene.ReadComponent<PortalET>(unit))
+      return SpectatorUnit::PORTAL;
+    return SpectatorUnit::OTHER;
+  }
+
+  static SpectatorPayload Pack(SpectatorMessage type, long tick,
+                               std::size_t chunk, Scene &scene,
+                               const std::vector<EntityId> &units,
+                               const std::vector<EntityId> &removed) {
+    auto out = std::make_shared<std::string>();
+    out->reserve(17 + units.size() * 18 + removed.size() * 4);
+    Put(*out, static_cast<uint8_t>(type));
+    Put(*out, static_cast<uint32_t>(tick));
+    Put(*out, static_cast<uint32_t>(chunk));
+    Put(*out, static_cast<uint32_t>(units.size()));
+    Put(*out, static_cast<uint32_t>(removed.size()));
+    for (EntityId unit : units) {
+      auto health = scene.ReadComponent<HealthET>(unit);
+      auto team = scene.ReadComponent<PlayerET>(unit)->player;
+      Vector3 position = scene.ReadComponent<TransformET>(unit)->position;
+      Put(*out, static_cast<uint32_t>(unit));
+      Put(*out, static_cast<uint8_t>(team));
+      Put(*out, static_cast<uint8_t>(KindOf(scene, unit)));
+      Put(*out, position.x);
+      Put(*out, position.z);
+      Put(*out, health ? health->currentHealth : 0.0f);
+    }
+    for (EntityId unit : removed) {
+      Put(*out, static_cast<uint32_t>(unit));
+    }
+    return out;
+  }
+
+public:
+  explicit SpectatorEncoder(int keyframeInterval = 30)
+      : keyframeInterval(keyframeInterval) {}
+
+  std::shared_ptr<SpectatorFrame> Encode(Match &match) {
+    Scene &scene = match.GetScene();
+    auto frame = std::make_shared<SpectatorFrame>();
+    frame->tick = match.GetTick();
+    frame->chunksX = match.GetChunks().ChunksX();
+    changes.resize(match.GetChunks().Count());
+    for (auto &chunk : changes) {
+      chunk.units.clear();
+      chunk.removed.clear();
+    }
+
+    for (EntityId unit : match.GetFallen()) {
+      auto it = unitChunks.find(unit);
+      if (it != unitChunks.end()) {
+        changes[it->second].removed.push_back(unit);
+        unitChunks.erase(it);
+      }
+    }
+    changed.clear();
+    auto collect = [this](EntityId unit) { changed.push_back(unit); };
+    scene.QueryChanged<TransformET, PlayerET>(seen, collect);
+    scene.QueryChanged<HealthET, TransformET, PlayerET>(seen, collect);
+    std::sort(changed.begin(), changed.end());
+    changed.erase(std::unique(changed.begin(), changed.end()), changed.end());
+    for (EntityId unit : changed) {
+      std::size_t chunk =
+          match.ChunkOf(scene.ReadComponent<TransformET>(unit)->position);
+      auto [it, isNew] = unitChunks.try_emplace(unit, chunk);
+      if (!isNew && it->second != chunk) {
+        changes[it->second].removed.push_back(unit);
+        it->second = chunk;
+      }
+      changes[chunk].units.push_back(unit);
+    }
+    seen = scene.AdvanceChangeTick();
+
+    frame->deltas.resize(changes.size());
+    for (std::size_t chunk = 0; chunk < changes.size(); chunk++) {
+      if (changes[chunk].units.empty() && changes[chunk].removed.empty())
+        continue;
+      frame->deltas[chunk] =
+          Pack(SpectatorMessage::DELTA, frame->tick, chunk, scene,
+               changes[chunk].units, changes[chunk].removed);
+    }
+
+    if (frame->tick % keyframeInterval == 0) {
+      for (auto &chunk : changes) {
+        chunk.units.clear();
+      }
+      for (const auto &[unit, chunk] : unitChunks) {
+        changes[chunk].units.push_back(unit);
+      }
+      frame->keyframes.resize(changes.size());
+      for (std::size_t chunk = 0; chunk < changes.size(); chunk++) {
+        if (changes[chunk].units.empty())
+          continue;
+        frame->keyframes[chunk] =
+            Pack(SpectatorMessage::KEYFRAME, frame->tick, chunk, scene,
+                 changes[chunk].units, {});
+      }
+      frame->reset =
+          Pack(SpectatorMessage::RESET, frame->tick, 0, scene, {}, {});
+    }
+    return frame;
+  }
+};
+
+// What one spectator watches and whether it has to catch up.
+class SpectatorView {
+private:
+  bool everything = true;
+  int focusX = 0;
+  int focusZ = 0;
+  int radius = 0;
+  bool needsKeyframe = true;
+
+public:
+  enum class Send { NOTHING, DELTAS, KEYFRAMES };
+
+  // Chunks within radius of (x, z), like ChunkGrid::InView.
+  void Focus(int x, int z, int chunkRadius) {
+    everything = false;
+    focusX = x;
+    focusZ = z;
+    radius = chunkRadius;
+    needsKeyframe = true;
+  }
+
+  void WatchEverything() {
+    everything = true;
+    needsKeyframe = true;
+  }
+
+  bool Sees(const SpectatorFrame &frame, std::size_t chunk) const {
+    if (everything)
+      return true;
+    int x = static_cast<int>(chunk % frame.chunksX);
+    int z = static_cast<int>(chunk / frame.chunksX);
+    return std::abs(x - focusX) <= radius && std::abs(z - focusZ) <= radius;
+  }
+
+  // Spectators that fall more than maxBacklog bytes behind stop getting
+  // deltas and pick up again with the first keyframe after they have drained
+  // half of it.
+  Send Admit(const SpectatorFrame &frame, std::size_t backlog,
+             std::size_t maxBacklog) {
+    if (needsKeyframe) {
+      if (frame.keyframes.empty() || backlog > maxBacklog / 2)
+        return Send::NOTHING;
+      needsKeyframe = false;
+      return Send::KEYFRAMES;
+    }
+    if (backlog > maxBacklog) {
+      needsKeyframe = true;
+      return Send::NOTHING;
+    }
+    return Send::DELTAS;
+  }
+
+  void Resync() { needsKeyframe = true; }
+};
@@ -0,0 +1,164 @@
+#pragma once
+#include "SpectatorFeed.hpp"
+#include <atomic>
+#include <cstdio>
+#include <map>
+#include <thread>
+#include <websocketpp/config/asio_no_tls.hpp>
+#include <websocketpp/server.hpp>
+
+// Websocket endpoint that streams SpectatorFrames to every connected
+// spectator. Publish only hands the frame to the network thread, so the
+// simulation never waits on spectators. There every payload a spectator
+// needs is framed into a prepared message the first time it is sent in a
+// tick, and that same message is queued on all connections that get it.
+//
+// A spectator watches the whole map until it sends "focus <x> <z> <radius>"
+// in chunks; "all" goes back to the whole map.
+class SpectatorServer {
+private:
+  using WsServer = websocketpp::server<websocketpp::config::asio>;
+
+  WsServer server;
+  std::thread network;
+  std::size_t maxBacklog;
+  std::size_t maxQueuedFrames;
+  // Frames handed over but not yet sent; past maxQueuedFrames new frames are
+  // dropped and everybody resyncs from the next keyframe.
+  std::atomic<std::size_t> queuedFrames{0};
+  std::atomic<bool> dropped{false};
+
+  // Only touched on the network thread.
+  std::map<websocketpp::connection_hdl, SpectatorView,
+           std::owner_less<websocketpp::connection_hdl>>
+      spectators;
+
+  // Frames the payload once with the connection's processor, taking its
+  // bytes. The result is prepared, so every connection sends it as is.
+  static WsServer::message_ptr Prepare(WsServer::connection_ptr connection,
+                                       std::string &payload) {
+    auto in = connection->get_message(websocketpp::frame::opcode::binary, 0);
+    in->get_raw_payload().swap(payload);
+    auto out = connection->get_message(websocketpp::frame::opcode::binary, 0);
+    if (connection->get_processor()->prepare_data_frame(in, out))
+      return nullptr;
+    return out;
+  }
+
+  void Deliver(SpectatorFrame &frame) {
+    if (dropped.exchange(false)) {
+      for (auto &[connection, view] : spectators) {
+        view.Resync();
+      }
+    }
+
+    const std::vector<SpectatorPayload> *sources[] = {&frame.deltas,
+                                                      &frame.keyframes};
+    std::vector<WsServer::message_ptr> framed[2];
+    WsServer::message_ptr reset;
+    for (auto &[handle, view] : spectators) {
+      websocketpp::lib::error_code error;
+      WsServer::connection_ptr connection =
+          server.get_con_from_hdl(handle, error);
+      if (error)
+        continue;
+
+      auto send = view.Admit(frame, connection->get_buffered_amount(),
+                             maxBacklog);
+      if (send == SpectatorView::Send::NOTHING)
+        continue;
+
+      int kind = send == SpectatorView::Send::KEYFRAMES;
+      if (kind == 1) {
+        if (!reset) {
+          reset = Prepare(connection, *frame.reset);
+        }
+        if (reset) {
+          connection->send(reset);
+        }
+      }
+      const auto &payloads = *sources[kind];
+      framed[kind].resize(payloads.size());
+      for (std::size_t chunk = 0; chunk < payloads.size(); chunk++) {
+        if (!payloads[chunk] || !view.Sees(frame, chunk))
+          continue;
+        auto &message = framed[kind][chunk];
+        if (!message) {
+          message = Prepare(connection, *payloads[chunk]);
+        }
+        if (message) {
+          connection->send(message);
+        }
+      }
+    }
+  }
+
+  void OnMessage(websocketpp::connection_hdl handle,
+                 WsServer::message_ptr message) {
+    auto it = spectators.find(handle);
+    if (it == spectators.end())
+      return;
+
+    int x, z, radius;
+    const std::string &text = message->get_payload();
+    if (std::sscanf(text.c_str(), "focus %d %d %d", &x, &z, &radius) == 3) {
+      it->second.Focus(x, z, radius);
+    } else if (text == "all") {
+      it->second.WatchEverything();
+    }
+  }
+
+public:
+  explicit SpectatorServer(std::size_t maxBacklog = 1 << 20,
+                           std::size_t maxQueuedFrames = 8)
+      : maxBacklog(maxBacklog), maxQueuedFrames(maxQueuedFrames) {
+    server.clear_access_channels(websocketpp::log::alevel::all);
+    server.clear_error_channels(websocketpp::log::elevel::all);
+    server.init_asio();
+    server.set_reuse_addr(true);
+    server.set_open_handler([this](websocketpp::connection_hdl handle) {
+      spectators.emplace(handle, SpectatorView());
+    });
+    server.set_close_handler([this](websocketpp::connection_hdl handle) {
+      spectators.erase(handle);
+    });
+    server.set_fail_handler([this](websocketpp::connection_hdl handle) {
+      spectators.erase(handle);
+    });
+    server.set_message_handler(
+        [this](websocketpp::connection_hdl handle,
+               WsServer::message_ptr message) { OnMessage(handle, message); });
+  }
+
+  ~SpectatorServer() { Stop(); }
+
+  void Start(uint16_t port) {
+    server.listen(port);
+    server.start_accept();
+    network = std::thread([this]() { server.run(); });
+  }
+
+  void Stop() {
+    if (!network.joinable())
+      return;
+    server.stop();
+    network.join();
+  }
+
+  // Called by the simulation after every encoded tick.
+  // The server takes the frame over and empties its payloads.
+  void Publish(std::shared_ptr<SpectatorFrame> frame) {
+    if (queuedFrames >= maxQueuedFrames) {
+      dropped = true;
+      return;
+    }
+    queuedFrames++;
+    websocketpp::lib::asio::post(server.get_io_service(), [this, frame]() {
+      Deliver(*frame);
+      queuedFrames--;
+    });
+  }
+
+  // Approximate; read from the simulation thread.
+  std::size_t QueuedFrames() const { return queuedFrames; }
+};
@@ -0,0 +1,177 @@
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <memory_resource>
+#include <new>
+#include <nlohmann/json.hpp>
+#include <string>
+#include <typeinfo>
+#include <vector>
+
+#if __has_include(<cxxabi.h>)
+#include <cstdlib>
+#include <cxxabi.h>
+#endif
+
+struct AllocationCounter {
+  std::size_t liveBytes = 0;
+  std::size_t highWaterBytes = 0;
+  std::size_t liveAllocations = 0;
+  std::size_t totalAllocations = 0;
+  std::size_t totalBytes = 0;
+
+  void OnAllocate(std::size_t bytes) {
+    liveBytes += bytes;
+    highWaterBytes = std::max(highWaterBytes, liveBytes);
+    liveAllocations++;
+    totalAllocations++;
+    totalBytes += bytes;
+  }
+
+  void OnFree(std::size_t bytes) {
+    liveBytes -= bytes;
+    liveAllocations--;
+  }
+};
+
+// Standard allocator that reports every allocation to a counter. The counter
+// has to outlive everything allocated through it.
+template <typename T> struct CountingAllocator {
+  using value_type = T;
+
+  AllocationCounter *counter;
+
+  explicit CountingAllocator(AllocationCounter *c) : counter(c) {}
+
+  template <typename U>
+  CountingAllocator(const CountingAllocator<U> &other)
+      : counter(other.counter) {}
+
+  T *allocate(std::size_t n) {
+    counter->OnAllocate(n * sizeof(T));
+    return static_cast<T *>(::operator new(n * sizeof(T)));
+  }
+
+  void deallocate(T *p, std::size_t n) {
+    counter->OnFree(n * sizeof(T));
+    ::operator delete(p);
+  }
+
+  template <typename U>
+  bool operator==(const CountingAllocator<U> &other) const {
+    return counter == other.counter;
+  }
+  template <typename U>
+  bool operator!=(const CountingAllocator<U> &other) const {
+    return counter != other.counter;
+  }
+};
+
+// Heap memory resource that reports to a counter, meant as the upstream of a
+// pool: the counter then sees the blocks the pool takes from the heap rather
+// than every node carved out of them.
+class CountingResource : public std::pmr::memory_resource {
+private:
+  AllocationCounter *counter;
+
+  void *do_allocate(std::size_t bytes, std::size_t alignment) override {
+    counter->OnAllocate(bytes);
+    return ::operator new(bytes, std::align_val_t(alignment));
+  }
+
+  void do_deallocate(void *p, std::size_t bytes,
+                     std::size_t alignment) override {
+    counter->OnFree(bytes);
+    ::operator delete(p, bytes, std::align_val_t(alignment));
+  }
+
+  bool do_is_equal(const std::pmr::memory_resource &other) const
+      noexcept override {
+    return this == &other;
+  }
+
+public:
+  explicit CountingResource(AllocationCounter *c) : counter(c) {}
+};
+
+inline std::string ReadableTypeName(const std::type_info &type) {
+#if __has_include(<cxxabi.h>)
+  int status = 0;
+  char *demangled = abi::__cxa_demangle(type.name(), nullptr, nullptr, &status);
+  if (status == 0 && demangled) {
+    std::string name(demangled);
+    std::free(demangled);
+    return name;
+  }
+#endif
+  return type.name();
+}
+
+// Memory held by one kind of thing: a component type or a subsystem.
+// count is the number of live elements, elementBytes their payload size, and
+// capacityBytes what is reserved for them, including container slack that the
+// allocation counter cannot see.
+struct MemoryEntry {
+  std::string name;
+  std::size_t count = 0;
+  std::size_t elementBytes = 0;
+  std::size_t capacityBytes = 0;
+  AllocationCounter allocations;
+};
+
+struct MemoryReport {
+  std::vector<MemoryEntry> components;
+  std::vector<MemoryEntry> subsystems;
+
+  std::size_t LiveBytes() const {
+    std::size_t total = 0;
+    for (const auto &entry : components)
+      total += entry.allocations.liveBytes;
+    for (const auto &entry : subsystems)
+      total += std::max(entry.allocations.liveBytes, entry.capacityBytes);
+    return total;
+  }
+
+  // Sum of the per-entry peaks: an upper bound on the overall peak.
+  std::size_t HighWaterBytes() const {
+    std::size_t total = 0;
+    for (const auto &entry : components)
+      total += entry.allocations.highWaterBytes;
+    for (const auto &entry : subsystems)
+      total += std::max(entry.allocations.highWaterBytes, entry.capacityBytes);
+    return total;
+  }
+
+  void Merge(const MemoryReport &other) {
+    components.insert(components.end(), other.components.begin(),
+                      other.components.end());
+    subsystems.insert(subsystems.end(), other.subsystems.begin(),
+                      other.subsystems.end());
+  }
+
+  std::string ToJson() const {
+    nlohmann::json report = {{"liveBytes", LiveBytes()},
+                             {"highWaterBytes", HighWaterBytes()},
+                             {"components", EntriesJson(components)},
+                             {"subsystems", EntriesJson(subsystems)}};
+    return report.dump();
+  }
+
+private:
+  static nlohmann::json EntriesJson(const std::vector<MemoryEntry> &entries) {
+    nlohmann::json array = nlohmann::json::array();
+    for (const MemoryEntry &entry : entries) {
+      const AllocationCounter &a = entry.allocations;
+      array.push_back({{"name", entry.name},
+                       {"count", entry.count},
+                       {"elementBytes", entry.elementBytes},
+                       {"capacityBytes", entry.capacityBytes},
+                       {"liveBytes", a.liveBytes},
+                       {"highWaterBytes", a.highWaterBytes},
+                       {"liveAllocations", a.liveAllocations},
+                       {"totalAllocations", a.totalAllocations},
+                       {"totalBytes", a.totalBytes}});
+    }
+    return array;
+  }
+};
@@ -0,0 +1,151 @@
+#pragma once
+#include "ECS.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <vector>
+
+// ACTIVE chunks are simulated every tick. DORMANT chunks keep their tiles
+// and units but only simulate on every dormantTickInterval-th tick. A
+// PAGED_OUT chunk has no tile entities; its tiles are still in the cooked
+// map and are instantiated again when the chunk wakes up.
+enum class ChunkState { PAGED_OUT, DORMANT, ACTIVE };
+
+struct WorldChunk {
+  ChunkState state = ChunkState::PAGED_OUT;
+  std::vector<EntityId> tiles;
+  // Units standing in the chunk, kept up to date by the match.
+  uint32_t units = 0;
+  // Ticks since the chunk last held a unit or was in view.
+  long idleTicks = 0;
+  // Whether the chunk waits in the queue for the next Due.
+  bool queued = false;
+};
+
+// Chunk bookkeeping for a map of chunksX * chunksZ chunks, indexed
+// z * chunksX + x like the cooked tiles. The grid keeps the chunks that are
+// not paged out in a list of their own, so a pass over the live part of the
+// world costs nothing for the rest of the map.
+class ChunkGrid {
+private:
+  uint32_t chunksX = 0;
+  uint32_t chunksZ = 0;
+  std::vector<WorldChunk> chunks;
+  // Chunks that are not paged out, ascending.
+  std::vector<std::size_t> resident;
+  // Paged-out chunks queued since the last Due, and what Due returned.
+  std::vector<std::size_t> queue;
+  std::vector<std::size_t> due;
+
+public:
+  void Reset(uint32_t x, uint32_t z) {
+    chunksX = x;
+    chunksZ = z;
+    chunks.assign(std::size_t(x) * z, WorldChunk());
+    resident.clear();
+    queue.clear();
+    due.clear();
+  }
+
+  std::size_t Count() const { return chunks.size(); }
+  uint32_t ChunksX() const { return chunksX; }
+  uint32_t ChunksZ() const { return chunksZ; }
+  uint32_t ChunkX(std::size_t index) const { return index % chunksX; }
+  uint32_t ChunkZ(std::size_t index) const { return index / chunksX; }
+  std::size_t Index(uint32_t x, uint32_t z) const {
+    return std::size_t(z) * chunksX + x;
+  }
+
+  WorldChunk &operator[](std::size_t index) { return chunks[index]; }
+  const WorldChunk &operator[](std::size_t index) const {
+    return chunks[index];
+  }
+
+  const std::vector<std::size_t> &Resident() const { return resident; }
+
+  bool InView(std::size_t index, std::size_t focus, int radius) const {
+    int dx = static_cast<int>(ChunkX(index)) - static_cast<int>(ChunkX(focus));
+    int dz = static_cast<int>(ChunkZ(index)) - static_cast<int>(ChunkZ(focus));
+    return std::abs(dx) <= radius && std::abs(dz) <= radius;
+  }
+
+  // Asks for a paged-out chunk to be planned by the next Due; resident
+  // chunks always are.
+  void Queue(std::size_t index) {
+    WorldChunk &chunk = chunks[index];
+    if (chunk.state == ChunkState::PAGED_OUT && !chunk.queued) {
+      chunk.queued = true;
+      queue.push_back(index);
+    }
+  }
+
+  // Queues the chunks within radius of focus.
+  void QueueAround(std::size_t focus, int radius) {
+    int focusX = static_cast<int>(ChunkX(focus));
+    int focusZ = static_cast<int>(ChunkZ(focus));
+    for (int z = std::max(focusZ - radius, 0);
+         z <= std::min(focusZ + radius, static_cast<int>(chunksZ) - 1); z++) {
+      for (int x = std::max(focusX - radius, 0);
+           x <= std::min(focusX + radius, static_cast<int>(chunksX) - 1);
+           x++) {
+        Queue(Index(x, z));
+      }
+    }
+  }
+
+  // The chunks whose state may change now, ascending: the resident ones and
+  // those queued since the last call. A paged-out chunk nobody queued stays
+  // paged out, so it is left alone.
+  const std::vector<std::size_t> &Due() {
+    due.assign(resident.begin(), resident.end());
+    for (std::size_t index : queue) {
+      chunks[index].queued = false;
+      due.push_back(index);
+    }
+    queue.clear();
+    std::sort(due.begin(), due.end());
+    return due;
+  }
+
+  // Moves a chunk to state, keeping the resident list in step.
+  void SetState(std::size_t index, ChunkState state) {
+    WorldChunk &chunk = chunks[index];
+    bool wasResident = chunk.state != ChunkState::PAGED_OUT;
+    bool isResident = state != ChunkState::PAGED_OUT;
+    chunk.state = state;
+    if (wasResident == isResident)
+      return;
+    auto it = std::lower_bound(resident.begin(), resident.end(), index);
+    if (isResident) {
+      resident.insert(it, index);
+    } else {
+      resident.erase(it);
+    }
+  }
+
+  // Where a chunk should be next: active in view, dormant while it holds
+  // units or has been idle for less than pageOutTicks, paged out after that.
+  // A paged-out chunk stays out until it is in view or a unit enters it.
+  ChunkState Plan(std::size_t index, bool inView, long pageOutTicks) {
+    WorldChunk &chunk = chunks[index];
+    chunk.idleTicks = inView || chunk.units > 0 ? 0 : chunk.idleTicks + 1;
+    if (inView)
+      return ChunkState::ACTIVE;
+    if (chunk.units > 0)
+      return ChunkState::DORMANT;
+    if (chunk.state == ChunkState::PAGED_OUT ||
+        chunk.idleTicks >= pageOutTicks)
+      return ChunkState::PAGED_OUT;
+    return ChunkState::DORMANT;
+  }
+
+  std::size_t CountIn(ChunkState state) const {
+    if (state == ChunkState::PAGED_OUT)
+      return chunks.size() - resident.size();
+    std::size_t count = 0;
+    for (std::size_t index : resident) {
+      count += chunks[index].state == state;
+    }
+    return count;
+  }
+};
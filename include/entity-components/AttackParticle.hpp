@@ -3,13 +3,15 @@
 
 class AttackParticle : public Particle {
 private:
+  Vector3 origin;
   Vector3 target;
   float progress;
   float speed;
 
 public:
   AttackParticle(Vector3 start, Vector3 end, Color c, float spd = 4.0f)
-      : Particle(start, c), target(end), progress(0.0f), speed(spd) {}
+      : Particle(start, c), origin(start), target(end), progress(0.0f),
+        speed(spd) {}
 
   void Update(float deltaTime) override {
     if (!active)
@@ -22,7 +24,7 @@ public:
       return;
     }
 
-    position = Vector3Lerp(position, target, progress);
+    position = Vector3Lerp(origin, target, progress);
   }
 
   void Draw() override {
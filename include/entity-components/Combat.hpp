@@ -37,7 +37,12 @@ public:
       : defense(def), blockChance(block) {}
 
   float CalculateDamageReduction(float incomingDamage) const {
-    if (GetRandomValue(0, 100) < blockChance * 100) {
+    return CalculateDamageReduction(incomingDamage, GetRandomValue(0, 100));
+  }
+
+  // roll is a uniform draw from [0, 100], for callers that own their RNG.
+  float CalculateDamageReduction(float incomingDamage, int roll) const {
+    if (roll < blockChance * 100) {
       return 0.0f;
     }
     return std::max(0.0f, incomingDamage - defense);
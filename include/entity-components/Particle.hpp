@@ -1,4 +1,5 @@
 #pragma once
+#include "Telemetry.hpp"
 #include <raylib.h>
 #include <raymath.h>
 #include <vector>
@@ -15,9 +16,21 @@ struct Particle {
   virtual ~Particle() = default;
 };
 
+// Frees a particle and reports its size back to the system's counter.
+struct CountedParticleDelete {
+  AllocationCounter *counter;
+  std::size_t bytes;
+
+  void operator()(Particle *particle) const {
+    counter->OnFree(bytes);
+    delete particle;
+  }
+};
+
 class ParticleSystem {
 private:
-  std::vector<std::unique_ptr<Particle>> particles;
+  AllocationCounter allocations;
+  std::vector<std::unique_ptr<Particle, CountedParticleDelete>> particles;
 
 public:
   void Update(float deltaTime) {
@@ -37,6 +50,19 @@ public:
   }
 
   template <typename T, typename... Args> void AddParticle(Args &&...args) {
-    particles.push_back(std::make_unique<T>(std::forward<Args>(args)...));
+    allocations.OnAllocate(sizeof(T));
+    particles.emplace_back(new T(std::forward<Args>(args)...),
+                           CountedParticleDelete{&allocations, sizeof(T)});
+  }
+
+  MemoryEntry GetMemoryEntry() const {
+    MemoryEntry entry;
+    entry.name = "ParticleSystem";
+    entry.count = particles.size();
+    entry.elementBytes = sizeof(particles[0]);
+    entry.capacityBytes =
+        allocations.liveBytes + particles.capacity() * sizeof(particles[0]);
+    entry.allocations = allocations;
+    return entry;
   }
 };
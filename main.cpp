@@ -1,17 +1,20 @@
 #include "ECS.hpp"
+#include "Interaction.hpp"
+#include "Match.hpp"
+#include "Pipeline.hpp"
 #include "entity-components/Transform.hpp"
 #include "raylib.h"
 #include "raymath.h"
-#include <unordered_map>
+#include <random>
 
 const int WINDOW_WIDTH = 1920;
 const int WINDOW_HEIGHT = 1080;
 const float GRID_SIZE = 2.0f;
 const float ISOMETRIC_ANGLE = 30.0f * DEG2RAD;
 const float CAMERA_DISTANCE = 35.0f;
+// World units per second.
+const float CAMERA_PAN_SPEED = 30.0f;
 
-const int gridSize = 17;
-const float tileSize = 2.0f;
 const float baseHeight = 0.5f;
 const int wallWidth = 2;
 
@@ -32,185 +35,246 @@ enum class SpawnState {
   SELECTING_PORTAL_END
 };
 
+MatchConfig InteractiveMatchConfig(const std::string &mapPath) {
+  MatchConfig config;
+  config.mapPath = mapPath;
+  config.seed = std::random_device{}();
+  return config;
+}
+
+// Pipeline tags: the tile under the mouse, and the match's points, tick,
+// chunk states, RNG and scratch buffers.
+struct PickResult {};
+struct MatchState {};
+
 class Game {
 private:
-  Scene scene;
+  Match match;
+  Scene &scene;
   Camera3D camera;
   float cameraAngle;
-  std::unordered_map<Player, int> points;
-  EntityId player1Reactor;
-  EntityId player2Reactor;
   SpawnState currentState = SpawnState::NONE;
   Vector3 portalStartPos;
   std::vector<EntityId> selectedEntities;
-  ParticleSystem particleSystem;
+  // What the number key last pressed started; fed the tile of every click.
+  Interaction<Vector3> interaction;
+  float frameTime = 0.0f;
+  EntityId hoveredEntity = -1;
+  Vector3 hitPosition = {0};
+  // "current/max" text per entity, rebuilt only when its health changes.
+  std::unordered_map<EntityId, std::string> healthLabels;
+  uint32_t healthLabelsSeen = 0;
+
+  struct PickingSystem {
+    using reads = Reads<SceneStructure, TransformET, TileET, Camera3D>;
+    using writes = Writes<PickResult>;
+    void Run(Game &game) { game.PickTile(); }
+  };
+
+  // Portal selection fills the match's candidate buffer and F3 reads the
+  // particle system for the memory report.
+  struct InputSystem {
+    using reads = Reads<PickResult, Camera3D, SceneStructure, TransformET,
+                        PlayerET, ParticleSystem>;
+    using writes = Writes<Command, MatchState>;
+    void Run(Game &game) {
+      game.HandleInput(game.hoveredEntity, game.hitPosition);
+    }
+  };
+
+  struct ParticleSystemUpdate {
+    using reads = Reads<>;
+    using writes = Writes<ParticleSystem>;
+    void Run(Game &game) { game.match.GetParticles().Update(game.frameTime); }
+  };
+
+  struct CameraSystem {
+    using reads = Reads<>;
+    using writes = Writes<Camera3D>;
+    void Run(Game &game) { game.UpdateCamera(); }
+  };
+
+  struct CommandSystem {
+    using reads = Reads<>;
+    using writes = Writes<Command, SceneStructure, MatchState, TransformET>;
+    void Run(Game &game) { game.match.ApplyCommands(); }
+  };
+
+  // The match streams in the chunks around what the camera looks at.
+  struct TickSystem {
+    using reads = Reads<Camera3D>;
+    using writes = Writes<SceneStructure, MatchState>;
+    void Run(Game &game) {
+      game.match.SetFocus(game.camera.target);
+      game.match.BeginTick();
+    }
+  };
+
+  struct CooldownSystem {
+    using reads = Reads<SceneStructure, TransformET>;
+    using writes = Writes<AttackerET, MatchState>;
+    void Run(Game &game) { game.match.UpdateCooldowns(game.frameTime); }
+  };
+
+  struct MatchParticleUpdate {
+    using reads = Reads<>;
+    using writes = Writes<ParticleSystem>;
+    void Run(Game &game) { game.match.GetParticles().Update(game.frameTime); }
+  };
+
+  struct FireSystem {
+    using reads = Reads<SceneStructure, TransformET, PlayerET, HealthET>;
+    using writes = Writes<AttackerET, ProjectileFiredEvent, MatchState>;
+    void Run(Game &game) { game.match.FireAttacks(); }
+  };
+
+  struct ProjectileSystem {
+    using reads = Reads<SceneStructure, ProjectileFiredEvent, TransformET,
+                        PlayerET, HealthET>;
+    using writes = Writes<ProjectileHitEvent, MatchState>;
+    void Run(Game &game) { game.match.UpdateProjectiles(game.frameTime); }
+  };
+
+  struct DamageSystem {
+    using reads = Reads<SceneStructure, ProjectileHitEvent, DefenderET>;
+    using writes = Writes<HealthET, DamageEvent, DeathEvent, MatchState>;
+    void Run(Game &game) { game.match.ApplyDamage(); }
+  };
+
+  struct AttackParticleSystem {
+    using reads = Reads<SceneStructure, DamageEvent, TransformET>;
+    using writes = Writes<ParticleSystem>;
+    void Run(Game &game) { game.match.EmitAttackParticles(); }
+  };
+
+  struct ScoreSystem {
+    using reads = Reads<DeathEvent>;
+    using writes = Writes<MatchState>;
+    void Run(Game &game) { game.match.ScoreKills(); }
+  };
+
+  struct CleanupSystem {
+    using reads = Reads<DeathEvent>;
+    using writes = Writes<SceneStructure, MatchState>;
+    void Run(Game &game) { game.match.RemoveDead(); }
+  };
+
+  struct WinConditionSystem {
+    using reads = Reads<SceneStructure, HealthET>;
+    using writes = Writes<>;
+    void Run(Game &game) { game.CheckWinCondition(); }
+  };
+
+  // The frame in its original order. The first particle update overlaps the
+  // camera and commands, the second the tick, and attack tracers overlap
+  // scoring; the rest of the frame is serial.
+  Pipeline<PickingSystem, InputSystem, ParticleSystemUpdate, CameraSystem,
+           CommandSystem, TickSystem, CooldownSystem, MatchParticleUpdate,
+           FireSystem, ProjectileSystem, DamageSystem, AttackParticleSystem,
+           ScoreSystem, CleanupSystem, WinConditionSystem>
+      frame;
 
 public:
-  Game() : cameraAngle(-PI / 4) {
+  explicit Game(const std::string &mapPath)
+      : match(InteractiveMatchConfig(mapPath)), scene(match.GetScene()),
+        cameraAngle(-PI / 4) {
     InitWindow(WINDOW_WIDTH, WINDOW_HEIGHT, "Made in Heaven");
     SetTargetFPS(60);
-    InitializeGrid();
     InitializeCamera();
-    InitializeGame();
   }
 
   ~Game() { CloseWindow(); }
 
-  void InitializeGrid() {
-    for (int x = 0; x < gridSize; x++) {
-      for (int z = 0; z < gridSize; z++) {
-        EntityId entity = scene.NewEntity();
-        float height = (z == gridSize / 2) ? 6.0f : 1.0f;
-        TerrainType type =
-            (z == gridSize / 2) ? TerrainType::DIRT : TerrainType::GRASS;
-
-        int gridX = x - gridSize / 2;
-        int gridZ = z - gridSize / 2;
-
-        scene.AssignEntity<TransformET>(
-            entity,
-            TransformET({static_cast<float>(gridX * tileSize), height / 2.0f,
-                         static_cast<float>(gridZ * tileSize)}));
-        scene.AssignEntity<TileET>(entity, TileET(type, height));
-      }
-    }
-  }
-
-  EntityId CreateWall(Vector3 position, Player owner) {
-    EntityId entity = scene.NewEntity();
-
-    scene.AssignEntity<TransformET>(entity, position);
-    scene.AssignEntity<RenderableET>(
-        entity, owner == Player::PLAYER1 ? DARKGREEN : DARKPURPLE,
-        EntityType::WALL, 2.0f, 2.0f);
-
-    DefenderET defense;
-    defense.defense = 5.0f;
-    defense.blockChance = 0.3f;
-    scene.AssignEntity<DefenderET>(entity, defense);
-
-    scene.AssignEntity<HealthET>(entity, 75.0f);
-    scene.AssignEntity<PlayerET>(entity, owner);
-
-    return entity;
-  }
-
-  EntityId CreateAttacker(Vector3 position, Player owner) {
-    EntityId entity = scene.NewEntity();
-
-    scene.AssignEntity<TransformET>(entity, position);
-    scene.AssignEntity<RenderableET>(entity,
-                                     owner == Player::PLAYER1 ? BLUE : RED,
-                                     EntityType::ATTACKER, 2.0f, 2.0f);
-
-    AttackerET attacker;
-    attacker.damage = 10.0f;
-    attacker.range = 4.0f * 4;
-    attacker.attackCooldown = 1.0f;
-    attacker.currentCooldown = 0.0f;
-    scene.AssignEntity<AttackerET>(entity, attacker);
-
-    scene.AssignEntity<HealthET>(entity, 50.0f);
-    scene.AssignEntity<PlayerET>(entity, owner);
-
-    return entity;
-  }
-
-  Vector3 SnapToGrid(const Vector3 &position) {
-    int x = round(position.x / tileSize);
-    int z = round(position.z / tileSize);
-    return {static_cast<float>(x * tileSize), position.y + 1.0f,
-            static_cast<float>(z * tileSize)};
-  }
-
-  bool IsValidSpawnPosition(const Vector3 &position) {
-    float halfGrid = (gridSize * tileSize) / 2.0f;
-    return position.x >= -halfGrid && position.x <= halfGrid &&
-           position.z >= -halfGrid && position.z <= halfGrid;
-  }
-
   void HandleInput(EntityId hoveredEntity, const Vector3 &hitPosition) {
     if (IsKeyPressed(KEY_ONE))
-      currentState = SpawnState::SPAWN_ATTACKER;
+      interaction = SpawnOnClick(SpawnState::SPAWN_ATTACKER);
     if (IsKeyPressed(KEY_TWO))
-      currentState = SpawnState::SELECTING_PORTAL_START;
+      interaction = SelectPortal();
     if (IsKeyPressed(KEY_THREE))
-      currentState = SpawnState::SPAWN_WALL;
+      interaction = SpawnOnClick(SpawnState::SPAWN_WALL);
     if (IsKeyPressed(KEY_ESCAPE)) {
+      interaction.Reset();
       currentState = SpawnState::NONE;
       selectedEntities.clear();
     }
+    if (IsKeyPressed(KEY_F3)) {
+      TraceLog(LOG_INFO, "MEMORY: %s",
+               match.GetMemoryReport().ToJson().c_str());
+    }
 
     if (IsMouseButtonPressed(MOUSE_BUTTON_LEFT) && hoveredEntity != -1) {
-      Vector3 spawnPos = SnapToGrid(hitPosition);
-
-      if (!IsValidSpawnPosition(spawnPos))
-        return;
-
-      switch (currentState) {
-      case SpawnState::SPAWN_ATTACKER:
-        if (points[GetCurrentPlayer()] >= 100) {
-          CreateAttacker(spawnPos, GetCurrentPlayer());
-          points[GetCurrentPlayer()] -= 100;
-        }
-        break;
-
-      case SpawnState::SELECTING_PORTAL_START:
-        if (points[GetCurrentPlayer()] >= 200) {
-          portalStartPos = spawnPos;
-          selectedEntities = GetEntitiesAtPosition(spawnPos);
-
-          selectedEntities.erase(
-              std::remove_if(selectedEntities.begin(), selectedEntities.end(),
-                             [this](EntityId entity) {
-                               auto playerComp =
-                                   scene.GetComponent<PlayerET>(entity);
-                               return !playerComp ||
-                                      playerComp->player != GetCurrentPlayer();
-                             }),
-              selectedEntities.end());
-
-          if (!selectedEntities.empty()) {
-            currentState = SpawnState::SELECTING_PORTAL_END;
-          }
-        }
-        break;
-
-      case SpawnState::SELECTING_PORTAL_END:
-        if (!selectedEntities.empty()) {
-          for (auto entity : selectedEntities) {
-
-            if (!scene.GetComponent<TileET>(entity)) {
-              TeleportEntity(entity, spawnPos);
-            }
-          }
-          points[GetCurrentPlayer()] -= 200;
-          currentState = SpawnState::NONE;
-          selectedEntities.clear();
-        }
-        break;
-      case SpawnState::SPAWN_WALL:
-        if (points[GetCurrentPlayer()] >= 150) {
-          CreateWall(spawnPos, GetCurrentPlayer());
-          points[GetCurrentPlayer()] -= 150;
-        }
-        break;
+      Vector3 spawnPos = match.SnapToGrid(hitPosition);
+      if (match.IsValidSpawnPosition(spawnPos)) {
+        interaction.Feed(spawnPos);
+      }
+    }
+  }
 
-      default:
-        break;
+  // Buys an attacker or a wall on every clicked tile until cancelled.
+  Interaction<Vector3> SpawnOnClick(SpawnState mode) {
+    currentState = mode;
+    selectedEntities.clear();
+    for (;;) {
+      Vector3 position = co_await Interaction<Vector3>::Next();
+      if (mode == SpawnState::SPAWN_ATTACKER) {
+        match.Submit(SpawnAttacker{GetCurrentPlayer(), position});
+      } else {
+        match.Submit(SpawnWall{GetCurrentPlayer(), position});
       }
     }
   }
 
+  // Waits for a tile with some of the player's units on it, then for the
+  // tile to portal them to.
+  Interaction<Vector3> SelectPortal() {
+    currentState = SpawnState::SELECTING_PORTAL_START;
+    do {
+      portalStartPos = co_await Interaction<Vector3>::Next();
+      selectedEntities =
+          match.SelectPortalEntities(GetCurrentPlayer(), portalStartPos);
+    } while (selectedEntities.empty());
+
+    currentState = SpawnState::SELECTING_PORTAL_END;
+    Vector3 destination = co_await Interaction<Vector3>::Next();
+    match.Submit(PortalMove{GetCurrentPlayer(), selectedEntities, destination});
+    currentState = SpawnState::NONE;
+    selectedEntities.clear();
+  }
+
   Player GetCurrentPlayer() {
     return (cameraAngle < 0) ? Player::PLAYER1 : Player::PLAYER2;
   }
 
+  void UpdateHealthLabels() {
+    scene.QueryChanged<HealthET>(healthLabelsSeen, [this](EntityId entity) {
+      auto health = scene.ReadComponent<HealthET>(entity);
+      healthLabels[entity] =
+          std::to_string(static_cast<int>(health->currentHealth)) + "/" +
+          std::to_string(static_cast<int>(health->maxHealth));
+    });
+    healthLabelsSeen = scene.AdvanceChangeTick();
+
+    // Labels of removed entities are dropped once they are half the cache.
+    if (healthLabels.size() > 2 * scene.Query<HealthET>().size()) {
+      for (auto it = healthLabels.begin(); it != healthLabels.end();) {
+        it = scene.ReadComponent<HealthET>(it->first) ? std::next(it)
+                                                      : healthLabels.erase(it);
+      }
+    }
+  }
+
   void RenderEntities() {
-    for (auto entity : scene.GetAllEntities()) {
-      auto transform = scene.GetComponent<TransformET>(entity);
-      auto renderable = scene.GetComponent<RenderableET>(entity);
-      auto health = scene.GetComponent<HealthET>(entity);
+    UpdateHealthLabels();
+    for (auto entity : scene.Query<TransformET, RenderableET>()) {
+      auto transform = scene.ReadComponent<TransformET>(entity);
+      auto renderable = scene.ReadComponent<RenderableET>(entity);
+      auto health = scene.ReadComponent<HealthET>(entity);
+      auto owner = scene.ReadComponent<PlayerET>(entity);
+
+      // Enemy units under the viewing player's fog are not drawn.
+      if (owner && owner->player != GetCurrentPlayer() &&
+          !match.IsVisibleTo(GetCurrentPlayer(), transform->position))
+        continue;
 
       if (transform && renderable) {
         Color color = renderable->color;
@@ -249,9 +313,7 @@ public:
                      segmentWidth, barHeight, 0.1f, GREEN);
           }
 
-          std::string healthText =
-              std::to_string(static_cast<int>(health->currentHealth)) + "/" +
-              std::to_string(static_cast<int>(health->maxHealth));
+          const std::string &healthText = healthLabels[entity];
 
           Vector2 screenPos = GetWorldToScreen(healthBarPos, camera);
 
@@ -264,51 +326,6 @@ public:
     }
   }
 
-  EntityId FindNearestTarget(const Vector3 &position, Player owner) {
-    EntityId nearestTarget = -1;
-    float minDistance = INFINITY;
-
-    for (auto entity : scene.GetAllEntities()) {
-      auto playerComp = scene.GetComponent<PlayerET>(entity);
-      auto transform = scene.GetComponent<TransformET>(entity);
-      auto health = scene.GetComponent<HealthET>(entity);
-
-      if (playerComp && transform && health && playerComp->player != owner &&
-          health->IsAlive() &&
-          (scene.GetComponent<AttackerET>(entity) || entity == player1Reactor ||
-           entity == player2Reactor)) {
-
-        float distance = Vector3Distance(position, transform->position);
-        if (distance < minDistance) {
-          minDistance = distance;
-          nearestTarget = entity;
-        }
-      }
-    }
-    return nearestTarget;
-  }
-
-  EntityId FindNearestEnemy(const Vector3 &position, Player owner) {
-    EntityId nearest = -1;
-    float minDistance = INFINITY;
-
-    for (auto entity : scene.GetAllEntities()) {
-      auto playerComp = scene.GetComponent<PlayerET>(entity);
-      auto transform = scene.GetComponent<TransformET>(entity);
-      auto health = scene.GetComponent<HealthET>(entity);
-
-      if (playerComp && transform && health && playerComp->player != owner &&
-          health->IsAlive()) {
-        float distance = Vector3Distance(position, transform->position);
-        if (distance < minDistance) {
-          minDistance = distance;
-          nearest = entity;
-        }
-      }
-    }
-    return nearest;
-  }
-
   void InitializeCamera() {
     camera.position = {20.0f, 20.0f, 20.0f};
     camera.target = {0.0f, 0.0f, 0.0f};
@@ -317,56 +334,24 @@ public:
     camera.projection = CAMERA_PERSPECTIVE;
   }
 
-  void InitializeGame() {
-    points[Player::PLAYER1] = 1000;
-    points[Player::PLAYER2] = 1000;
-
-    Vector3 player1Pos = SnapToGrid({0.0f, 3.0f, -14.0f});
-    Vector3 player2Pos = SnapToGrid({0.0f, 3.0f, 14.0f});
-
-    player1Reactor = CreateReactor(player1Pos, Player::PLAYER1);
-    player2Reactor = CreateReactor(player2Pos, Player::PLAYER2);
-  }
-
-  EntityId CreateReactor(Vector3 position, Player team) {
-    EntityId entity = scene.NewEntity();
-
-    scene.AssignEntity<TransformET>(entity, position);
-    scene.AssignEntity<RenderableET>(entity,
-                                     team == Player::PLAYER1 ? BLUE : RED,
-                                     EntityType::REACTOR, 1.0f, 6.0f);
-    scene.AssignEntity<HealthET>(entity, 100.0f);
-    scene.AssignEntity<PlayerET>(entity, team);
-
-    return entity;
-  }
-
-  EntityId CreatePortal(Vector3 position, Player team) {
-    EntityId entity = scene.NewEntity();
-
-    scene.AssignEntity<TransformET>(entity, position);
-    scene.AssignEntity<RenderableET>(entity,
-                                     team == Player::PLAYER1 ? BLUE : RED,
-                                     EntityType::PORTAL, 2.0f, 0.5f);
-    scene.AssignEntity<PortalET>(entity);
-    scene.AssignEntity<PlayerET>(entity, team);
-
-    return entity;
+  void Update() {
+    frameTime = GetFrameTime();
+    frame.Run(*this);
   }
 
-  void Update() {
+  void PickTile() {
     Vector2 mousePosition = GetMousePosition();
     Ray ray = GetMouseRay(mousePosition, camera);
 
     RayCollision closestCollision = {0};
     closestCollision.distance = INFINITY;
     closestCollision.hit = false;
-    EntityId hoveredEntity = -1;
-    Vector3 hitPosition = {0};
+    hoveredEntity = -1;
+    hitPosition = {0};
 
-    for (const EntityId &entity : scene.entities) {
-      TransformET *transform = scene.GetComponent<TransformET>(entity);
-      TileET *tile = scene.GetComponent<TileET>(entity);
+    for (const EntityId &entity : scene.Query<TransformET, TileET>()) {
+      const TransformET *transform = scene.ReadComponent<TransformET>(entity);
+      const TileET *tile = scene.ReadComponent<TileET>(entity);
 
       if (transform && tile) {
         BoundingBox box =
@@ -380,130 +365,38 @@ public:
         }
       }
     }
-
-    HandleInput(hoveredEntity, hitPosition);
-    particleSystem.Update(GetFrameTime());
-    UpdateCamera();
-    UpdateEntities();
-    CheckWinCondition();
   }
 
+  // Q and E orbit the camera around its target, WASD pan the target across
+  // the map relative to where the camera looks.
   void UpdateCamera() {
     if (IsKeyDown(KEY_Q))
       cameraAngle -= 0.02f;
     if (IsKeyDown(KEY_E))
       cameraAngle += 0.02f;
 
-    camera.position = {cosf(cameraAngle) * CAMERA_DISTANCE,
+    // From the camera towards the target, and to its right.
+    Vector2 forward = {-cosf(cameraAngle), -sinf(cameraAngle)};
+    Vector2 right = {-forward.y, forward.x};
+    Vector2 pan = {0.0f, 0.0f};
+    if (IsKeyDown(KEY_W))
+      pan = Vector2Add(pan, forward);
+    if (IsKeyDown(KEY_S))
+      pan = Vector2Subtract(pan, forward);
+    if (IsKeyDown(KEY_D))
+      pan = Vector2Add(pan, right);
+    if (IsKeyDown(KEY_A))
+      pan = Vector2Subtract(pan, right);
+    pan = Vector2Scale(Vector2Normalize(pan), CAMERA_PAN_SPEED * frameTime);
+
+    float halfWidth = match.GetMap().Width() * tileSize / 2.0f;
+    float halfDepth = match.GetMap().Depth() * tileSize / 2.0f;
+    camera.target.x = Clamp(camera.target.x + pan.x, -halfWidth, halfWidth);
+    camera.target.z = Clamp(camera.target.z + pan.y, -halfDepth, halfDepth);
+
+    camera.position = {camera.target.x + cosf(cameraAngle) * CAMERA_DISTANCE,
                        CAMERA_DISTANCE * sinf(ISOMETRIC_ANGLE),
-                       sinf(cameraAngle) * CAMERA_DISTANCE};
-  }
-
-  void UpdateEntities() {
-    for (auto entity : scene.GetEntitiesWithComponent<AttackerET>()) {
-      auto attacker = scene.GetComponent<AttackerET>(entity);
-      if (attacker && attacker->currentCooldown > 0) {
-        attacker->currentCooldown -= GetFrameTime();
-      }
-    }
-
-    particleSystem.Update(GetFrameTime());
-
-    for (auto entity : scene.GetEntitiesWithComponent<AttackerET>()) {
-      auto attacker = scene.GetComponent<AttackerET>(entity);
-      auto transform = scene.GetComponent<TransformET>(entity);
-      auto playerComp = scene.GetComponent<PlayerET>(entity);
-      auto health = scene.GetComponent<HealthET>(entity);
-
-      if (!attacker || !transform || !playerComp || !health ||
-          !health->IsAlive()) {
-        continue;
-      }
-
-      EntityId nearestTarget = -1;
-      float minDistance = INFINITY;
-
-      for (auto targetEntity : scene.GetAllEntities()) {
-        auto targetPlayerComp = scene.GetComponent<PlayerET>(targetEntity);
-        auto targetTransform = scene.GetComponent<TransformET>(targetEntity);
-        auto targetHealth = scene.GetComponent<HealthET>(targetEntity);
-
-        if (!targetPlayerComp || !targetTransform || !targetHealth ||
-            !targetHealth->IsAlive() ||
-            targetPlayerComp->player == playerComp->player) {
-          continue;
-        }
-
-        if (!scene.GetComponent<AttackerET>(targetEntity) &&
-            !scene.GetComponent<DefenderET>(targetEntity) &&
-            targetEntity != player1Reactor && targetEntity != player2Reactor) {
-          continue;
-        }
-
-        float distance =
-            Vector3Distance(transform->position, targetTransform->position);
-        if (distance < minDistance) {
-          minDistance = distance;
-          nearestTarget = targetEntity;
-        }
-      }
-
-      if (nearestTarget != -1) {
-        auto targetTransform = scene.GetComponent<TransformET>(nearestTarget);
-        auto targetHealth = scene.GetComponent<HealthET>(nearestTarget);
-        auto targetDefense = scene.GetComponent<DefenderET>(nearestTarget);
-
-        float distance =
-            Vector3Distance(transform->position, targetTransform->position);
-
-        if (distance <= attacker->range && attacker->CanAttack()) {
-          float finalDamage = attacker->damage;
-          if (targetDefense) {
-            finalDamage =
-                targetDefense->CalculateDamageReduction(attacker->damage);
-          }
-
-          targetHealth->TakeDamage(finalDamage);
-          attacker->Attack();
-
-          Color particleColor;
-          if (playerComp->player == Player::PLAYER1) {
-            particleColor = Color{0, 120, 255, 255};
-          } else {
-            particleColor = Color{255, 60, 60, 255};
-          }
-
-          Vector3 startPos = transform->position;
-          Vector3 endPos = targetTransform->position;
-          startPos.y += 1.0f;
-          endPos.y += 1.0f;
-
-          float damageReductionFactor = finalDamage / attacker->damage;
-          Color modifiedParticleColor = {
-              static_cast<unsigned char>(particleColor.r *
-                                         damageReductionFactor),
-              static_cast<unsigned char>(particleColor.g *
-                                         damageReductionFactor),
-              particleColor.b, particleColor.a};
-
-          particleSystem.AddParticle<AttackParticle>(
-              startPos, endPos, modifiedParticleColor, 4.0f);
-
-          if (!targetHealth->IsAlive()) {
-            points[playerComp->player] += finalDamage > 0 ? 50 : 25;
-          }
-        }
-      }
-    }
-
-    for (auto entity : scene.GetEntitiesWithComponent<HealthET>()) {
-      auto health = scene.GetComponent<HealthET>(entity);
-      if (health && !health->IsAlive()) {
-        if (entity != player1Reactor && entity != player2Reactor) {
-          scene.RemoveEntity(entity);
-        }
-      }
-    }
+                       camera.target.z + sinf(cameraAngle) * CAMERA_DISTANCE};
   }
 
   void Render() {
@@ -521,9 +414,9 @@ public:
     closestCollision.hit = false;
     EntityId hoveredEntity = -1;
 
-    for (const EntityId &entity : scene.entities) {
-      TransformET *transform = scene.GetComponent<TransformET>(entity);
-      TileET *tile = scene.GetComponent<TileET>(entity);
+    for (const EntityId &entity : scene.Query<TransformET, TileET>()) {
+      const TransformET *transform = scene.ReadComponent<TransformET>(entity);
+      const TileET *tile = scene.ReadComponent<TileET>(entity);
 
       if (transform && tile) {
         BoundingBox box =
@@ -538,15 +431,21 @@ public:
       }
     }
 
-    for (const EntityId &entity : scene.entities) {
-      TransformET *transform = scene.GetComponent<TransformET>(entity);
-      TileET *tile = scene.GetComponent<TileET>(entity);
+    for (const EntityId &entity : scene.Query<TransformET, TileET>()) {
+      const TransformET *transform = scene.ReadComponent<TransformET>(entity);
+      const TileET *tile = scene.ReadComponent<TileET>(entity);
 
       if (transform && tile) {
         BoundingBox box =
             GetBoundingBox(transform->position, tileSize, tile->height);
         bool isHovered = (entity == hoveredEntity);
         Color baseColor = GetTerrainColor(tile->type, tile->height, isHovered);
+        if (!match.IsVisibleTo(GetCurrentPlayer(), transform->position)) {
+          baseColor = {static_cast<unsigned char>(baseColor.r / 2),
+                       static_cast<unsigned char>(baseColor.g / 2),
+                       static_cast<unsigned char>(baseColor.b / 2),
+                       baseColor.a};
+        }
 
         DrawCube(transform->position, tileSize, tile->height, tileSize,
                  baseColor);
@@ -557,7 +456,8 @@ public:
 
     RenderEntities();
 
-    particleSystem.Draw();
+    match.GetParticles().Draw();
+    RenderProjectiles();
 
     if (currentState == SpawnState::SELECTING_PORTAL_END &&
         !selectedEntities.empty()) {
@@ -571,35 +471,23 @@ public:
     EndDrawing();
   }
 
-  std::vector<EntityId> GetEntitiesAtPosition(const Vector3 &position) {
-    std::vector<EntityId> entities;
-    for (auto entity : scene.GetAllEntities()) {
-      auto transform = scene.GetComponent<TransformET>(entity);
-      if (transform) {
-        Vector3 entityPos = transform->position;
-        if (abs(entityPos.x - position.x) < tileSize / 2.0f &&
-            abs(entityPos.z - position.z) < tileSize / 2.0f) {
-          entities.push_back(entity);
-        }
-      }
-    }
-    return entities;
-  }
-
-  void TeleportEntity(EntityId entityId, const Vector3 &destination) {
-    auto transform = scene.GetComponent<TransformET>(entityId);
-    if (transform) {
-      Vector3 newPos = destination;
-      newPos.y = transform->position.y;
-      transform->position = newPos;
+  void RenderProjectiles() {
+    const ProjectilePool &projectiles = match.GetProjectiles();
+    for (std::size_t i = 0; i < projectiles.Size(); i++) {
+      DrawSphere(projectiles.Position(i), 0.2f,
+                 projectiles.Team(i) == Player::PLAYER1
+                     ? Color{0, 120, 255, 255}
+                     : Color{255, 60, 60, 255});
     }
   }
 
   void RenderUI() {
-    DrawText(TextFormat("Player 1 Points: %08i", points[Player::PLAYER1]), 10,
-             10, 20, BLUE);
-    DrawText(TextFormat("Player 2 Points: %08i", points[Player::PLAYER2]), 10,
-             40, 20, RED);
+    DrawText(TextFormat("Player 1 Points: %08i",
+                        match.GetPoints(Player::PLAYER1)),
+             10, 10, 20, BLUE);
+    DrawText(TextFormat("Player 2 Points: %08i",
+                        match.GetPoints(Player::PLAYER2)),
+             10, 40, 20, RED);
 
     const char *stateText;
     switch (currentState) {
@@ -623,18 +511,14 @@ public:
   }
 
   void CheckWinCondition() {
-    auto reactor1 = scene.GetComponent<HealthET>(player1Reactor);
-    auto reactor2 = scene.GetComponent<HealthET>(player2Reactor);
-
-    if (reactor1 && reactor2) {
-      if (!reactor1->IsAlive()) {
-        DrawText("Player 2 Wins!", WINDOW_WIDTH / 2 - 100, WINDOW_HEIGHT / 2,
-                 40, RED);
-
-      } else if (!reactor2->IsAlive()) {
-        DrawText("Player 1 Wins!", WINDOW_WIDTH / 2 - 100, WINDOW_HEIGHT / 2,
-                 40, BLUE);
-      }
+    std::optional<Player> winner = match.GetWinner();
+
+    if (winner == Player::PLAYER2) {
+      DrawText("Player 2 Wins!", WINDOW_WIDTH / 2 - 100, WINDOW_HEIGHT / 2, 40,
+               RED);
+    } else if (winner == Player::PLAYER1) {
+      DrawText("Player 1 Wins!", WINDOW_WIDTH / 2 - 100, WINDOW_HEIGHT / 2, 40,
+               BLUE);
     }
   }
 
@@ -651,8 +535,8 @@ public:
   }
 };
 
-int main() {
-  Game game;
+int main(int argc, char **argv) {
+  Game game(argc > 1 ? argv[1] : "");
   while (!WindowShouldClose()) {
     game.Update();
     game.Render();
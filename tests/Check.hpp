@@ -0,0 +1,28 @@
+#pragma once
+#include <cstdio>
+
+// Minimal checks for the test executables. A failed CHECK is reported and
+// the test carries on; main returns TestResult() so ctest sees the failure.
+inline int &FailedChecks() {
+  static int failed = 0;
+  return failed;
+}
+
+// Variadic so that conditions with template argument lists need no extra
+// parentheses.
+#define CHECK(...)                                                             \
+  do {                                                                         \
+    if (!(__VA_ARGS__)) {                                                      \
+      std::fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__,    \
+                   #__VA_ARGS__);                                              \
+      FailedChecks()++;                                                        \
+    }                                                                          \
+  } while (0)
+
+inline int TestResult() {
+  if (FailedChecks() > 0) {
+    std::fprintf(stderr, "%d checks failed\n", FailedChecks());
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,41 @@
+#pragma once
+#include "Heightmap.hpp"
+#include "MapFormat.hpp"
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+// Maps shared by the tests.
+
+// size x size grass at height 1 with a ridge of height 6 along the middle
+// row, row 10 by default, cooked in memory.
+struct Terrain {
+  std::vector<uint8_t> bytes;
+  MapView map;
+  Heightmap heights;
+
+  explicit Terrain(uint32_t size = 20)
+      : Terrain(DefaultMapSource(size)) {}
+
+  explicit Terrain(const MapSource &source) {
+    bytes = CookMap(source);
+    map.Attach(bytes.data(), bytes.size());
+    heights.Attach(map);
+  }
+
+  uint32_t Cell(int x, int z) const {
+    return static_cast<uint32_t>(heights.Index(x, z));
+  }
+};
+
+// The default size x size map, 32 x 32 chunks with the reactors in the middle
+// columns of the first and last rows, cooked to "<name>_<size>.mihm". The
+// caller removes the file.
+inline std::string WriteMap(const std::string &name, uint32_t size) {
+  std::vector<uint8_t> bytes = CookMap(DefaultMapSource(size));
+  std::string path = name + "_" + std::to_string(size) + ".mihm";
+  std::ofstream(path, std::ios::binary)
+      .write(reinterpret_cast<const char *>(bytes.data()), bytes.size());
+  return path;
+}
@@ -0,0 +1,129 @@
+// Change ticks: which accesses count as changes, and that a consumer that
+// remembers AdvanceChangeTick sees every change exactly once.
+
+#include "Check.hpp"
+#include "ECS.hpp"
+#include <algorithm>
+
+std::vector<EntityId> Changed(Scene &scene, uint32_t since) {
+  std::vector<EntityId> changed;
+  scene.QueryChanged<HealthET>(
+      since, [&](EntityId entity) { changed.push_back(entity); });
+  return changed;
+}
+
+void TestAccesses() {
+  Scene scene;
+  EntityId entity = scene.NewEntity();
+  scene.AssignEntity<HealthET>(entity, 10.0f);
+  uint32_t seen = scene.AdvanceChangeTick();
+  CHECK(!scene.ChangedSince<HealthET>(entity, seen));
+
+  CHECK(scene.ReadComponent<HealthET>(entity)->currentHealth == 10.0f);
+  CHECK(!scene.ChangedSince<HealthET>(entity, seen));
+
+  scene.GetComponent<HealthET>(entity)->TakeDamage(1.0f);
+  CHECK(scene.ChangedSince<HealthET>(entity, seen));
+
+  seen = scene.AdvanceChangeTick();
+  scene.MarkChanged<HealthET>(entity);
+  CHECK(scene.ChangedSince<HealthET>(entity, seen));
+
+  // Other components and missing ones are not affected.
+  scene.AssignEntity<PlayerET>(entity, Player::PLAYER1);
+  seen = scene.AdvanceChangeTick();
+  scene.GetComponent<HealthET>(entity);
+  CHECK(!scene.ChangedSince<PlayerET>(entity, seen));
+  CHECK(!scene.ChangedSince<AttackerET>(entity, 0));
+}
+
+// A consumer that runs every tick sees each change once, including
+// components assigned one by one or in batches after it last ran.
+void TestConsumer() {
+  Scene scene;
+  std::vector<EntityId> first = scene.NewEntities(3, 1);
+  scene.AssignBatch<HealthET>(first, HealthET(10.0f));
+
+  uint32_t seen = 0;
+  CHECK(Changed(scene, seen) == first);
+  seen = scene.AdvanceChangeTick();
+  CHECK(Changed(scene, seen).empty());
+
+  EntityId later = scene.NewEntity();
+  scene.AssignEntity<HealthET>(later, 5.0f);
+  scene.GetComponent<HealthET>(first[1]);
+  CHECK(Changed(scene, seen) == std::vector<EntityId>({first[1], later}));
+  seen = scene.AdvanceChangeTick();
+  CHECK(Changed(scene, seen).empty());
+
+  // Replacing a component is a change too.
+  scene.AssignEntity<HealthET>(first[2], 20.0f);
+  CHECK(Changed(scene, seen) == std::vector<EntityId>({first[2]}));
+  CHECK(scene.GetChangeTick() == seen);
+}
+
+// Removed entities drop out of the changes; nothing else is reported.
+void TestRemoved() {
+  Scene scene;
+  std::vector<EntityId> wave = scene.NewEntities(4, 1);
+  scene.AssignBatch<HealthET>(wave, HealthET(10.0f));
+  uint32_t seen = scene.AdvanceChangeTick();
+  for (EntityId entity : wave) {
+    scene.GetComponent<HealthET>(entity);
+  }
+  scene.RemoveEntities({wave[0], wave[3]});
+  CHECK(Changed(scene, seen) == std::vector<EntityId>({wave[1], wave[2]}));
+  CHECK(!scene.ChangedSince<HealthET>(wave[0], 0));
+}
+
+std::size_t LoggedStamps(const Scene &scene) {
+  for (const auto &entry : scene.GetMemoryReport().subsystems) {
+    if (entry.name == "Scene.changeLogs")
+      return entry.count;
+  }
+  return 0;
+}
+
+// Consumers that ask at different rates each see an entity once per call,
+// in creation order, however often and in whatever order it was stamped.
+// One that fell behind the trimmed log still sees everything, and the log
+// keeps little more than what was stamped since the slowest recent reader.
+void TestChangeLog() {
+  Scene scene;
+  std::vector<EntityId> wave = scene.NewEntities(100, 1);
+  scene.AssignBatch<HealthET>(wave, HealthET(10.0f));
+  Changed(scene, 0);
+  uint32_t lagging = scene.AdvanceChangeTick();
+  uint32_t everyTick = lagging, everyTenth = lagging;
+
+  for (int tick = 1; tick <= 300; tick++) {
+    scene.GetComponent<HealthET>(wave[tick % 100]);
+    scene.GetComponent<HealthET>(wave[(tick + 1) % 100]);
+    scene.GetComponent<HealthET>(wave[tick % 100]);
+
+    std::vector<EntityId> changed = Changed(scene, everyTick);
+    std::vector<EntityId> expected = {wave[tick % 100],
+                                      wave[(tick + 1) % 100]};
+    std::sort(expected.begin(), expected.end());
+    CHECK(changed == expected);
+
+    if (tick % 10 == 0) {
+      changed = Changed(scene, everyTenth);
+      CHECK(changed.size() == 11);
+      CHECK(std::is_sorted(changed.begin(), changed.end()));
+      everyTenth = scene.GetChangeTick() + 1;
+    }
+    everyTick = scene.AdvanceChangeTick();
+  }
+
+  CHECK(Changed(scene, lagging) == wave);
+  CHECK(LoggedStamps(scene) < 300);
+}
+
+int main() {
+  TestAccesses();
+  TestConsumer();
+  TestRemoved();
+  TestChangeLog();
+  return TestResult();
+}
@@ -0,0 +1,124 @@
+// Every SIMD distance kernel the CPU supports has to agree exactly with the
+// scalar one, including the tail past the last full vector, team masks,
+// retired candidates and ties.
+
+#include "Check.hpp"
+#include "DistanceKernels.hpp"
+#include <random>
+
+using namespace kernels;
+
+std::vector<DistanceKernelTable> SupportedTables() {
+  std::vector<DistanceKernelTable> tables;
+#ifdef MIH_X86_KERNELS
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("sse2")) {
+    tables.push_back({"sse2", SquaredDistancesSSE, NearestSSE,
+                      WithinRadiusSSE, WithinSquareSSE});
+  }
+  if (__builtin_cpu_supports("avx2")) {
+    tables.push_back({"avx2", SquaredDistancesAVX2, NearestAVX2,
+                      WithinRadiusAVX2, WithinSquareAVX2});
+  }
+#endif
+  return tables;
+}
+
+// Positions on a coarse grid so that equal distances, and with them ties,
+// are common.
+PositionBuffer RandomBuffer(std::size_t count, std::mt19937 &rng) {
+  std::uniform_int_distribution<int> coordinate(-8, 8);
+  std::uniform_int_distribution<uint32_t> bits(0, 3);
+  PositionBuffer buffer;
+  for (std::size_t i = 0; i < count; i++) {
+    buffer.Push(i,
+                {coordinate(rng) * 0.5f, coordinate(rng) * 0.25f,
+                 coordinate(rng) * 0.5f},
+                bits(rng));
+  }
+  if (count > 2) {
+    buffer.Retire(count / 2);
+  }
+  return buffer;
+}
+
+void CompareWithScalar(const DistanceKernelTable &simd,
+                       const PositionBuffer &buffer, Vector3 origin) {
+  const DistanceKernelTable scalar = {"scalar", SquaredDistancesFallback,
+                                      NearestFallback, WithinRadiusFallback,
+                                      WithinSquareFallback};
+  std::size_t count = buffer.Size();
+
+  std::vector<float> expected(count), actual(count);
+  scalar.squaredDistances(buffer, origin, expected.data());
+  simd.squaredDistances(buffer, origin, actual.data());
+  CHECK(expected == actual);
+
+  for (uint32_t mask : {1u, 2u, 3u}) {
+    float expectedDistance = 0.0f, actualDistance = 0.0f;
+    std::ptrdiff_t expectedIndex =
+        scalar.nearest(buffer, origin, mask, &expectedDistance);
+    std::ptrdiff_t actualIndex =
+        simd.nearest(buffer, origin, mask, &actualDistance);
+    CHECK(expectedIndex == actualIndex);
+    CHECK(expectedDistance == actualDistance);
+
+    std::vector<uint8_t> expectedMask(count), actualMask(count);
+    scalar.withinRadius(buffer, origin, 4.0f, mask, expectedMask.data());
+    simd.withinRadius(buffer, origin, 4.0f, mask, actualMask.data());
+    CHECK(expectedMask == actualMask);
+
+    scalar.withinSquare(buffer, origin, 1.0f, mask, expectedMask.data());
+    simd.withinSquare(buffer, origin, 1.0f, mask, actualMask.data());
+    CHECK(expectedMask == actualMask);
+  }
+}
+
+void TestEquivalence() {
+  std::mt19937 rng(7);
+  std::uniform_real_distribution<float> coordinate(-4.0f, 4.0f);
+  for (const auto &table : SupportedTables()) {
+    for (std::size_t count :
+         {0, 1, 3, 4, 5, 7, 8, 9, 15, 16, 17, 31, 33, 1000, 1003}) {
+      for (int round = 0; round < 20; round++) {
+        PositionBuffer buffer = RandomBuffer(count, rng);
+        Vector3 origin = {coordinate(rng), coordinate(rng), coordinate(rng)};
+        CompareWithScalar(table, buffer, origin);
+      }
+    }
+  }
+}
+
+// The nearest of several candidates at the same distance is the first one.
+void TestTies() {
+  PositionBuffer buffer;
+  for (std::size_t i = 0; i < 40; i++) {
+    buffer.Push(i, {i % 2 ? 1.0f : -1.0f, 0.0f, 0.0f}, i < 21 ? 2u : 1u);
+  }
+  for (const auto &table : SupportedTables()) {
+    CHECK(table.nearest(buffer, {0.0f, 0.0f, 0.0f}, 1u, nullptr) == 21);
+    CHECK(table.nearest(buffer, {0.0f, 0.0f, 0.0f}, 3u, nullptr) == 0);
+    CHECK(table.nearest(buffer, {0.0f, 0.0f, 0.0f}, 4u, nullptr) == -1);
+  }
+  CHECK(NearestIndex(buffer, {0.0f, 0.0f, 0.0f}, 1u) == 21);
+}
+
+// Picking takes the tile square, corners included and edges excluded, and
+// ignores height.
+void TestSquare() {
+  PositionBuffer buffer;
+  buffer.Push(0, {0.9f, 5.0f, 0.9f}, 1u);
+  buffer.Push(1, {1.0f, 0.0f, 0.0f}, 1u);
+  buffer.Push(2, {-0.99f, 0.0f, 0.5f}, 1u);
+  buffer.Push(3, {0.0f, 0.0f, -1.01f}, 1u);
+  std::vector<uint8_t> inside(buffer.Size());
+  WithinSquare(buffer, {0.0f, 0.0f, 0.0f}, 1.0f, 1u, inside.data());
+  CHECK(inside == std::vector<uint8_t>({1, 0, 1, 0}));
+}
+
+int main() {
+  TestEquivalence();
+  TestTies();
+  TestSquare();
+  return TestResult();
+}
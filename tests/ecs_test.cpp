@@ -0,0 +1,112 @@
+// Batch spawning through prefabs: what it allocates, that every entity gets
+// its own components, and how long a batch's component blocks live.
+
+#include "Check.hpp"
+#include "ECS.hpp"
+#include "Prefab.hpp"
+
+// A copy, since reports are temporaries; unnamed when there is no such entry.
+MemoryEntry Find(const std::vector<MemoryEntry> &entries,
+                 const std::string &name) {
+  for (const auto &entry : entries) {
+    if (entry.name == name)
+      return entry;
+  }
+  return MemoryEntry();
+}
+
+Prefab AttackerPrefab() {
+  Prefab prefab;
+  prefab.With<AttackerET>(10.0f, 16.0f, 1.0f)
+      .With<HealthET>(50.0f)
+      .With<PlayerET>(Player::PLAYER2);
+  return prefab;
+}
+
+std::vector<Vector3> Row(std::size_t count) {
+  std::vector<Vector3> positions;
+  for (std::size_t i = 0; i < count; i++) {
+    positions.push_back({static_cast<float>(i), 0.0f, 1.0f});
+  }
+  return positions;
+}
+
+// A 10k wave takes a few pool blocks for the entity and component tables,
+// not one allocation per entity or component.
+void TestWaveAllocations() {
+  Scene scene;
+  const std::size_t count = 10000;
+  std::vector<EntityId> wave = SpawnBatch(scene, AttackerPrefab(), Row(count));
+  CHECK(wave.size() == count);
+
+  MemoryReport report = scene.GetMemoryReport();
+  MemoryEntry tables = Find(report.subsystems, "Scene.componentTables");
+  CHECK(tables.count == count);
+  CHECK(tables.allocations.totalAllocations < count / 100);
+
+  // The block object and its storage.
+  MemoryEntry health = Find(report.components, "HealthET");
+  CHECK(health.count == count);
+  CHECK(health.allocations.totalAllocations == 2);
+}
+
+void TestWaveComponents() {
+  Scene scene;
+  std::vector<EntityId> wave = SpawnBatch(scene, AttackerPrefab(), Row(100));
+
+  CHECK(scene.Query<TransformET, AttackerET, HealthET, PlayerET>().size() ==
+        100);
+  for (std::size_t i = 0; i < wave.size(); i++) {
+    CHECK(scene.ReadComponent<TransformET>(wave[i])->position.x == i);
+    CHECK(scene.ReadComponent<PlayerET>(wave[i])->player == Player::PLAYER2);
+  }
+
+  // Members share a block but not their values.
+  scene.GetComponent<HealthET>(wave[0])->TakeDamage(20.0f);
+  CHECK(scene.ReadComponent<HealthET>(wave[0])->currentHealth == 30.0f);
+  CHECK(scene.ReadComponent<HealthET>(wave[1])->currentHealth == 50.0f);
+}
+
+// A batch's block is freed with its last member, not before.
+void TestBlockLifetime() {
+  Scene scene;
+  std::vector<EntityId> wave = SpawnBatch(scene, AttackerPrefab(), Row(100));
+  std::size_t blockBytes =
+      Find(scene.GetMemoryReport().components, "HealthET")
+          .allocations.liveBytes;
+  CHECK(blockBytes >= 100 * sizeof(HealthET));
+
+  scene.RemoveEntities(std::vector<EntityId>(wave.begin(), wave.end() - 1));
+  MemoryEntry health = Find(scene.GetMemoryReport().components, "HealthET");
+  CHECK(health.count == 1);
+  CHECK(health.allocations.liveBytes == blockBytes);
+  CHECK(scene.Query<HealthET>().size() == 1);
+
+  scene.RemoveEntity(wave.back());
+  health = Find(scene.GetMemoryReport().components, "HealthET");
+  CHECK(health.count == 0);
+  CHECK(health.allocations.liveBytes == 0);
+}
+
+// Nodes of removed entities are reused, so respawning the same wave takes
+// nothing more from the heap.
+void TestTableReuse() {
+  Scene scene;
+  std::vector<EntityId> wave = SpawnBatch(scene, AttackerPrefab(), Row(1000));
+  scene.RemoveEntities(wave);
+  std::size_t allocations =
+      Find(scene.GetMemoryReport().subsystems, "Scene.componentTables")
+          .allocations.totalAllocations;
+
+  SpawnBatch(scene, AttackerPrefab(), Row(1000));
+  CHECK(Find(scene.GetMemoryReport().subsystems, "Scene.componentTables")
+            .allocations.totalAllocations == allocations);
+}
+
+int main() {
+  TestWaveAllocations();
+  TestWaveComponents();
+  TestBlockLifetime();
+  TestTableReuse();
+  return TestResult();
+}
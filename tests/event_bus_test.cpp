@@ -0,0 +1,117 @@
+// Event queues: ordering of events from several threads, what Clear keeps,
+// and that a frame like the last one allocates nothing.
+
+#include "Check.hpp"
+#include "EventBus.hpp"
+#include <cstdlib>
+#include <new>
+
+// Every allocation in this test program.
+std::atomic<std::size_t> allocations{0};
+
+void *operator new(std::size_t size) {
+  allocations++;
+  if (void *p = std::malloc(size ? size : 1))
+    return p;
+  throw std::bad_alloc();
+}
+void operator delete(void *p) noexcept { std::free(p); }
+void operator delete(void *p, std::size_t) noexcept { std::free(p); }
+
+struct Hit {
+  int thread;
+  int sequence;
+};
+
+// Publishes count events from each of threads threads, one thread after
+// another.
+void PublishFrom(EventQueue<Hit> &queue, int threads, int count) {
+  for (int t = 0; t < threads; t++) {
+    std::thread producer([&queue, t, count]() {
+      for (int i = 0; i < count; i++) {
+        queue.Publish({t, i});
+      }
+    });
+    producer.join();
+  }
+}
+
+void TestThreadsInOrder() {
+  EventQueue<Hit> queue;
+  PublishFrom(queue, 3, 100);
+  queue.Flush();
+  const auto &events = queue.Events();
+  CHECK(events.size() == 300);
+  bool ordered = true;
+  for (std::size_t i = 0; i < events.size(); i++) {
+    ordered = ordered && events[i].thread == int(i / 100) &&
+              events[i].sequence == int(i % 100);
+  }
+  CHECK(ordered);
+}
+
+// Events interleaved between threads come out in publish order, not grouped
+// by the thread that published first.
+void TestInterleavedThreads() {
+  EventQueue<Hit> queue;
+  auto publishOnce = [&queue](int thread, int sequence) {
+    std::thread([&queue, thread, sequence]() {
+      queue.Publish({thread, sequence});
+    }).join();
+  };
+  queue.Publish({0, 0});
+  publishOnce(1, 0);
+  queue.Publish({0, 1});
+  queue.Flush();
+  const auto &first = queue.Events();
+  CHECK(first.size() == 3);
+  CHECK(first[0].thread == 0 && first[1].thread == 1 && first[2].thread == 0);
+  CHECK(first[2].sequence == 1);
+  queue.Clear();
+
+  // The next frame another thread publishes before this one.
+  publishOnce(2, 0);
+  queue.Publish({0, 2});
+  queue.Flush();
+  CHECK(queue.Events().size() == 2);
+  CHECK(queue.Events()[0].thread == 2 && queue.Events()[1].thread == 0);
+}
+
+// Clear drops the flushed events only; whatever came after the Flush is
+// there in the next one.
+void TestClearKeepsUnflushed() {
+  EventQueue<Hit> queue;
+  queue.Publish({0, 1});
+  queue.Flush();
+  queue.Publish({0, 2});
+  queue.Clear();
+  CHECK(queue.Events().empty());
+  queue.Flush();
+  CHECK(queue.Events().size() == 1 && queue.Events()[0].sequence == 2);
+}
+
+// Once the buffers have grown, a frame publishing as much from the same
+// thread allocates nothing.
+void TestFramesReuseBuffers() {
+  EventQueue<Hit> queue;
+  for (int frame = 0; frame < 3; frame++) {
+    std::size_t before = allocations;
+    for (int i = 0; i < 1000; i++) {
+      queue.Publish({0, i});
+    }
+    queue.Flush();
+    CHECK(queue.Events().size() == 1000);
+    queue.Clear();
+    if (frame > 0) {
+      CHECK(allocations == before);
+    }
+  }
+}
+
+int main() {
+  TestThreadsInOrder();
+  TestInterleavedThreads();
+  TestClearKeepsUnflushed();
+  TestFramesReuseBuffers();
+  return TestResult();
+}
@@ -0,0 +1,110 @@
+// Fog of war: what a unit's stamp reveals, what terrain hides, and how
+// overlapping stamps keep cells visible.
+
+#include "Check.hpp"
+#include "FogOfWar.hpp"
+#include "TestMaps.hpp"
+
+void TestSightRadius() {
+  Terrain terrain;
+  FogOfWar fog;
+  fog.Reset(terrain.heights, 3, 2.0f);
+  CHECK(!fog.IsVisible(Player::PLAYER1, 5, 5));
+
+  fog.Place(1, Player::PLAYER1, 5, 5);
+  CHECK(fog.IsVisible(Player::PLAYER1, 5, 5));
+  CHECK(fog.IsVisible(Player::PLAYER1, 5, 8));
+  CHECK(fog.IsVisible(Player::PLAYER1, 7, 7));
+  CHECK(!fog.IsVisible(Player::PLAYER1, 5, 9));
+  CHECK(!fog.IsVisible(Player::PLAYER1, 8, 8));
+  CHECK(!fog.IsVisible(Player::PLAYER2, 5, 5));
+  CHECK(fog.VisibleMask(5, 5) == TeamBit(Player::PLAYER1));
+}
+
+// The ridge itself is seen, what lies behind it is not, unless the viewer
+// stands on it.
+void TestRidgeBlocks() {
+  Terrain terrain;
+  FogOfWar fog;
+  fog.Reset(terrain.heights, 5, 2.0f);
+  fog.Place(1, Player::PLAYER2, 5, 8);
+  CHECK(fog.IsVisible(Player::PLAYER2, 5, 10));
+  CHECK(!fog.IsVisible(Player::PLAYER2, 5, 11));
+  CHECK(!fog.IsVisible(Player::PLAYER2, 5, 13));
+
+  fog.Place(1, Player::PLAYER2, 5, 10);
+  CHECK(fog.IsVisible(Player::PLAYER2, 5, 13));
+  CHECK(fog.IsVisible(Player::PLAYER2, 5, 7));
+
+  // A higher block height sees over it.
+  fog.Reset(terrain.heights, 5, 5.0f);
+  fog.Place(1, Player::PLAYER2, 5, 8);
+  CHECK(fog.IsVisible(Player::PLAYER2, 5, 12));
+}
+
+// A cell stays visible while any stamp of the team covers it.
+void TestOverlappingStamps() {
+  Terrain terrain;
+  FogOfWar fog;
+  fog.Reset(terrain.heights, 2, 2.0f);
+  fog.Place(1, Player::PLAYER1, 3, 3);
+  fog.Place(2, Player::PLAYER1, 5, 3);
+  fog.Place(3, Player::PLAYER2, 4, 3);
+  CHECK(fog.VisibleMask(4, 3) ==
+        (TeamBit(Player::PLAYER1) | TeamBit(Player::PLAYER2)));
+
+  fog.Remove(1);
+  CHECK(fog.IsVisible(Player::PLAYER1, 4, 3));
+  CHECK(!fog.IsVisible(Player::PLAYER1, 1, 3));
+
+  // Moving a stamp uncovers where it was.
+  fog.Place(2, Player::PLAYER1, 15, 3);
+  CHECK(!fog.IsVisible(Player::PLAYER1, 4, 3));
+  CHECK(fog.IsVisible(Player::PLAYER1, 15, 3));
+
+  fog.Remove(2);
+  fog.Remove(2);
+  CHECK(!fog.IsVisible(Player::PLAYER1, 15, 3));
+  CHECK(fog.IsVisible(Player::PLAYER2, 4, 3));
+  CHECK(fog.GetMemoryEntry().count == 1);
+}
+
+// Coverage is only held for the chunks stamps reach: a stamp across a chunk
+// corner sees into all four, and once the stamps are gone nothing is left
+// but the per-chunk table.
+void TestChunkCoverage() {
+  Terrain terrain(256);
+  FogOfWar fog;
+  fog.Reset(terrain.heights, 3, 2.0f);
+  std::size_t empty = fog.GetMemoryEntry().capacityBytes;
+  CHECK(empty == 2 * 64 * sizeof(void *));
+
+  fog.Place(1, Player::PLAYER1, 32, 32);
+  fog.Place(2, Player::PLAYER1, 100, 40);
+  CHECK(fog.IsVisible(Player::PLAYER1, 30, 30));
+  CHECK(fog.IsVisible(Player::PLAYER1, 34, 30));
+  CHECK(fog.IsVisible(Player::PLAYER1, 30, 34));
+  CHECK(fog.IsVisible(Player::PLAYER1, 34, 34));
+  CHECK(!fog.IsVisible(Player::PLAYER1, 200, 200));
+  CHECK(!fog.IsVisible(Player::PLAYER2, 32, 32));
+  CHECK(fog.GetMemoryEntry().capacityBytes < 256 * 256 * 2);
+
+  // Moving within a chunk and out of it.
+  fog.Place(1, Player::PLAYER1, 33, 33);
+  fog.Place(2, Player::PLAYER1, 140, 40);
+  CHECK(fog.IsVisible(Player::PLAYER1, 140, 40));
+  CHECK(!fog.IsVisible(Player::PLAYER1, 100, 40));
+
+  fog.Remove(1);
+  fog.Remove(2);
+  CHECK(!fog.IsVisible(Player::PLAYER1, 33, 33));
+  CHECK(fog.GetMemoryEntry().capacityBytes == empty);
+}
+
+int main() {
+  TestSightRadius();
+  TestRidgeBlocks();
+  TestOverlappingStamps();
+  TestChunkCoverage();
+  return TestResult();
+}
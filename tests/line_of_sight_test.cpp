@@ -0,0 +1,153 @@
+// Line of sight over terrain and walls, and that cached rays follow the
+// walls as they come and go, in their own part of the map only.
+
+#include "Check.hpp"
+#include "LineOfSight.hpp"
+#include "TestMaps.hpp"
+#include <random>
+
+bool Clear(LineOfSight &sight, uint32_t from, uint32_t to) {
+  SightRay ray = {from, to};
+  uint8_t visible = 2;
+  sight.Check(&ray, 1, &visible);
+  return visible == 1;
+}
+
+void TestTerrain() {
+  Terrain t;
+  LineOfSight sight;
+  sight.Reset(t.heights, 1.0f, 3.0f);
+  CHECK(Clear(sight, t.Cell(5, 5), t.Cell(5, 5)));
+  CHECK(Clear(sight, t.Cell(5, 5), t.Cell(15, 5)));
+  CHECK(Clear(sight, t.Cell(5, 5), t.Cell(15, 9)));
+  CHECK(!Clear(sight, t.Cell(5, 5), t.Cell(5, 15)));
+  CHECK(!Clear(sight, t.Cell(5, 15), t.Cell(8, 2)));
+  // Down from the ridge, and onto it: no cell in between rises above.
+  CHECK(Clear(sight, t.Cell(5, 10), t.Cell(5, 18)));
+  CHECK(Clear(sight, t.Cell(5, 5), t.Cell(5, 10)));
+}
+
+// Cached rays change with the walls placed, moved and removed on their
+// path.
+void TestWallsInvalidate() {
+  Terrain t;
+  LineOfSight sight;
+  sight.Reset(t.heights, 1.0f, 3.0f);
+  uint32_t from = t.Cell(2, 5), to = t.Cell(12, 5);
+  CHECK(Clear(sight, from, to));
+
+  sight.PlaceWall(1, t.Cell(7, 5));
+  CHECK(!Clear(sight, from, to));
+  // A wall at either end does not block.
+  sight.PlaceWall(2, to);
+  sight.RemoveWall(1);
+  CHECK(Clear(sight, from, to));
+
+  sight.PlaceWall(1, t.Cell(7, 5));
+  sight.PlaceWall(3, t.Cell(7, 5));
+  sight.PlaceWall(1, t.Cell(7, 15));
+  CHECK(!Clear(sight, from, to));
+  sight.RemoveWall(3);
+  CHECK(Clear(sight, from, to));
+}
+
+// After any sequence of wall changes the cache answers what a fresh
+// instance with the same walls computes.
+void TestCacheMatchesFresh() {
+  Terrain t;
+  std::mt19937 rng(3);
+  std::uniform_int_distribution<uint32_t> cell(0, 20 * 20 - 1);
+  std::uniform_int_distribution<EntityId> wall(0, 15);
+  LineOfSight cached;
+  cached.Reset(t.heights, 1.0f, 3.0f);
+  std::unordered_map<EntityId, uint32_t> walls;
+
+  std::vector<SightRay> rays(200);
+  for (auto &ray : rays) {
+    ray = {cell(rng), cell(rng)};
+  }
+  std::vector<uint8_t> expected(rays.size()), actual(rays.size());
+
+  for (int round = 0; round < 50; round++) {
+    EntityId id = wall(rng);
+    if (rng() % 3 == 0) {
+      cached.RemoveWall(id);
+      walls.erase(id);
+    } else {
+      uint32_t at = cell(rng);
+      cached.PlaceWall(id, at);
+      walls[id] = at;
+    }
+
+    LineOfSight fresh;
+    fresh.Reset(t.heights, 1.0f, 3.0f);
+    for (const auto &[placed, at] : walls) {
+      fresh.PlaceWall(placed, at);
+    }
+    fresh.Check(rays.data(), rays.size(), expected.data());
+    cached.Check(rays.data(), rays.size(), actual.data());
+    CHECK(expected == actual);
+  }
+}
+
+// A wall only retraces the rays around its chunk: on a 64 x 64 map of four
+// chunks, one placed in the far chunk leaves a cached ray alone.
+void TestRegionInvalidation() {
+  Terrain t(64);
+  LineOfSight sight;
+  sight.Reset(t.heights, 1.0f, 3.0f);
+  CHECK(Clear(sight, t.Cell(2, 5), t.Cell(12, 5)));
+  CHECK(sight.Traces() == 1);
+  sight.PlaceWall(1, t.Cell(50, 50));
+  CHECK(Clear(sight, t.Cell(2, 5), t.Cell(12, 5)));
+  CHECK(sight.Traces() == 1);
+
+  sight.PlaceWall(1, t.Cell(7, 5));
+  CHECK(!Clear(sight, t.Cell(2, 5), t.Cell(12, 5)));
+  CHECK(sight.Traces() == 2);
+  // A ray reaching into the far chunk sees the wall there go.
+  sight.PlaceWall(2, t.Cell(40, 5));
+  CHECK(!Clear(sight, t.Cell(30, 5), t.Cell(50, 5)));
+  sight.RemoveWall(2);
+  CHECK(Clear(sight, t.Cell(30, 5), t.Cell(50, 5)));
+}
+
+// Walls on terrain near the top of the height range still block, and
+// however many rays are asked for the cache keeps its size.
+void TestHighTerrainAndBoundedCache() {
+  MapSource source = DefaultMapSource(64);
+  for (auto &tile : source.tiles) {
+    tile = MakeCookedTile(TerrainType::GRASS, 654.0f);
+  }
+  Terrain t(source);
+  CHECK(t.map.IsValid());
+
+  LineOfSight sight;
+  sight.Reset(t.heights, 1.0f, 3.0f);
+  std::size_t capacity = sight.GetMemoryEntry().capacityBytes;
+  uint32_t from = t.Cell(2, 5), to = t.Cell(12, 5);
+  sight.PlaceWall(1, t.Cell(7, 5));
+  CHECK(!Clear(sight, from, to));
+
+  std::vector<SightRay> rays;
+  for (uint32_t a = 0; a < 64 * 64; a += 3) {
+    for (uint32_t b = 0; b < 64 * 64; b += 97) {
+      rays.push_back({a, b});
+    }
+  }
+  std::vector<uint8_t> visible(rays.size());
+  sight.Check(rays.data(), rays.size(), visible.data());
+  // Only the wall's own bookkeeping was added.
+  CHECK(sight.GetMemoryEntry().capacityBytes <= capacity + 64);
+  CHECK(sight.GetMemoryEntry().count < rays.size());
+  CHECK(!Clear(sight, from, to));
+}
+
+int main() {
+  TestTerrain();
+  TestWallsInvalidate();
+  TestCacheMatchesFresh();
+  TestRegionInvalidation();
+  TestHighTerrainAndBoundedCache();
+  return TestResult();
+}
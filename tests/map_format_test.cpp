@@ -0,0 +1,155 @@
+// Cooking map descriptions and attaching to cooked maps, including the
+// malformed ones either side has to turn down.
+
+#include "Check.hpp"
+#include "MapCooker.hpp"
+#include <cstdio>
+#include <fstream>
+
+json SmallMap() {
+  return json::parse(R"({
+    "width": 5, "depth": 4, "chunkSize": 2,
+    "fill": {"type": "grass", "height": 1.5},
+    "regions": [{"x": 1, "z": 2, "width": 2, "tile": {"type": "stone"}}],
+    "spawnZones": [{"player": 1, "x": 0, "z": 0, "width": 5, "depth": 1}],
+    "reactors": [{"player": 1, "x": 2, "z": 0}, {"player": 2, "x": 2, "z": 3}],
+    "walls": [{"player": 2, "x": 4, "z": 3}]
+  })");
+}
+
+bool Rejected(const json &root) {
+  try {
+    ParseMap(root);
+  } catch (const std::exception &) {
+    return true;
+  }
+  return false;
+}
+
+void TestRoundTrip() {
+  std::vector<uint8_t> bytes = CookMap(ParseMap(SmallMap()));
+  MapView map;
+  CHECK(map.Attach(bytes.data(), bytes.size()));
+  CHECK(map.Width() == 5 && map.Depth() == 4);
+  CHECK(map.ChunksX() == 3 && map.ChunksZ() == 2);
+  CHECK(map.TileAt(0, 0).Type() == TerrainType::GRASS);
+  CHECK(map.TileAt(0, 0).Height() == 1.5f);
+  CHECK(map.TileAt(2, 2).Type() == TerrainType::STONE);
+  CHECK(map.TileAt(3, 2).Type() == TerrainType::GRASS);
+  CHECK(map.ReactorCount() == 2 && map.Reactors()[1].player == 1);
+  CHECK(map.WallCount() == 1 && map.Walls()[0].x == 4);
+  CHECK(map.SpawnZoneCount() == 1 && map.SpawnZones()[0].Contains(4, 0));
+}
+
+void TestCookerRejects() {
+  json negative = SmallMap();
+  negative["fill"]["height"] = -1.0;
+  CHECK(Rejected(negative));
+
+  json tall = SmallMap();
+  tall["regions"][0]["tile"]["height"] = 700.0;
+  CHECK(Rejected(tall));
+
+  json outside = SmallMap();
+  outside["walls"][0]["x"] = 5;
+  CHECK(Rejected(outside));
+
+  json oneReactor = SmallMap();
+  oneReactor["reactors"].erase(1);
+  CHECK(Rejected(oneReactor));
+}
+
+MapHeader &HeaderOf(std::vector<uint8_t> &bytes) {
+  return *reinterpret_cast<MapHeader *>(bytes.data());
+}
+
+template <typename T> T &At(std::vector<uint8_t> &bytes, uint64_t offset) {
+  return *reinterpret_cast<T *>(bytes.data() + offset);
+}
+
+// Every field the game reads unchecked is checked on attach.
+void TestAttachRejects() {
+  const std::vector<uint8_t> good = CookMap(ParseMap(SmallMap()));
+  auto attaches = [](std::vector<uint8_t> bytes) {
+    MapView map;
+    return map.Attach(bytes.data(), bytes.size());
+  };
+  CHECK(attaches(good));
+  CHECK(!attaches(std::vector<uint8_t>(good.begin(), good.end() - 1)));
+
+  std::vector<uint8_t> bytes = good;
+  HeaderOf(bytes).tilesOffset = UINT64_MAX - 8;
+  CHECK(!attaches(bytes));
+
+  bytes = good;
+  HeaderOf(bytes).wallsOffset = good.size() + 2;
+  HeaderOf(bytes).wallCount = 0;
+  CHECK(!attaches(bytes));
+
+  bytes = good;
+  HeaderOf(bytes).reactorCount = UINT32_MAX;
+  CHECK(!attaches(bytes));
+
+  bytes = good;
+  HeaderOf(bytes).reactorsOffset += 1;
+  CHECK(!attaches(bytes));
+
+  bytes = good;
+  At<MapObject>(bytes, HeaderOf(bytes).reactorsOffset).x = 5;
+  CHECK(!attaches(bytes));
+
+  bytes = good;
+  At<MapObject>(bytes, HeaderOf(bytes).reactorsOffset).player = 2;
+  CHECK(!attaches(bytes));
+
+  // Each player needs exactly one reactor, or the match can never end.
+  bytes = good;
+  HeaderOf(bytes).reactorCount = 1;
+  CHECK(!attaches(bytes));
+
+  bytes = good;
+  At<MapObject>(bytes, HeaderOf(bytes).reactorsOffset).player = 1;
+  CHECK(!attaches(bytes));
+
+  bytes = good;
+  At<MapObject>(bytes, HeaderOf(bytes).wallsOffset).z = 4;
+  CHECK(!attaches(bytes));
+
+  bytes = good;
+  At<MapSpawnZone>(bytes, HeaderOf(bytes).spawnZonesOffset).width = 6;
+  CHECK(!attaches(bytes));
+
+  bytes = good;
+  HeaderOf(bytes).chunkSize = 0;
+  CHECK(!attaches(bytes));
+}
+
+void TestMappedFile() {
+  std::vector<uint8_t> bytes = CookMap(DefaultMapSource(40));
+  std::string path = "map_format_test.mihm";
+  std::ofstream(path, std::ios::binary)
+      .write(reinterpret_cast<const char *>(bytes.data()), bytes.size());
+
+  MappedFile file;
+  CHECK(file.Open(path));
+  CHECK(file.Size() == bytes.size());
+  MapView map;
+  CHECK(map.Attach(file.Data(), file.Size()));
+  CHECK(map.TileAt(7, 20).Type() == TerrainType::DIRT);
+  CHECK(map.TileAt(7, 20).Height() == 6.0f);
+
+  // Released pages read back the same.
+  file.Release(0, file.Size());
+  CHECK(map.TileAt(7, 20).Height() == 6.0f);
+  file.Close();
+  std::remove(path.c_str());
+  CHECK(!file.Open(path));
+}
+
+int main() {
+  TestRoundTrip();
+  TestCookerRejects();
+  TestAttachRejects();
+  TestMappedFile();
+  return TestResult();
+}
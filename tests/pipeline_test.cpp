@@ -0,0 +1,124 @@
+// The pipeline scheduler: stages worked out from reads and writes, order
+// across stages, and the worker threads that run a stage's systems.
+
+#include "Check.hpp"
+#include "Pipeline.hpp"
+#include <atomic>
+#include <set>
+#include <stdexcept>
+
+struct A {};
+struct B {};
+struct C {};
+
+struct Context {
+  std::atomic<int> a{0};
+  std::atomic<int> b{0};
+  int sumSeen = -1;
+  std::mutex mutex;
+  std::set<std::thread::id> threads;
+  bool fail = false;
+
+  void Record() {
+    std::lock_guard<std::mutex> lock(mutex);
+    threads.insert(std::this_thread::get_id());
+  }
+};
+
+struct WriteA {
+  using reads = Reads<>;
+  using writes = Writes<A>;
+  void Run(Context &context) {
+    context.a++;
+    context.Record();
+  }
+};
+
+struct WriteB {
+  using reads = Reads<>;
+  using writes = Writes<B>;
+  void Run(Context &context) {
+    context.b++;
+    context.Record();
+  }
+};
+
+struct ReadC {
+  using reads = Reads<C>;
+  using writes = Writes<>;
+  void Run(Context &context) {
+    if (context.fail)
+      throw std::runtime_error("failed");
+    context.Record();
+  }
+};
+
+struct ReadAB {
+  using reads = Reads<A, B>;
+  using writes = Writes<C>;
+  void Run(Context &context) { context.sumSeen = context.a + context.b; }
+};
+
+using Frame = Pipeline<WriteA, WriteB, ReadC, ReadAB, WriteA>;
+
+// Disjoint systems share a stage; a reader waits for the writers before it,
+// a writer for the readers before it.
+static_assert(Frame::stages[0] == 0 && Frame::stages[1] == 0 &&
+              Frame::stages[2] == 0);
+static_assert(Frame::stages[3] == 1 && Frame::stages[4] == 2);
+static_assert(Frame::stageCount == 3);
+static_assert(Pipeline<WriteA, WriteA>::stages[1] == 1);
+
+// A later stage sees everything the earlier ones did.
+void TestOrder() {
+  Frame frame;
+  Context context;
+  for (int run = 1; run <= 100; run++) {
+    frame.Run(context);
+    CHECK(context.sumSeen == 3 * run - 1);
+  }
+  CHECK(context.a == 200 && context.b == 100);
+}
+
+// The widest stage has three systems: two run on workers that are started
+// once and then reused, never on new threads.
+void TestWorkersReused() {
+  Frame frame;
+  CHECK(frame.WorkerCount() == 2);
+  Context context;
+  for (int run = 0; run < 100; run++) {
+    frame.Run(context);
+  }
+  CHECK(context.threads.size() <= 3);
+  CHECK(context.threads.count(std::this_thread::get_id()) == 1);
+
+  Pipeline<WriteA, WriteA> serial;
+  CHECK(serial.WorkerCount() == 0);
+}
+
+// An exception from a worker reaches the caller once its stage is done and
+// skips the later stages; the pipeline still runs afterwards.
+void TestWorkerException() {
+  Frame frame;
+  Context context;
+  context.fail = true;
+  bool thrown = false;
+  try {
+    frame.Run(context);
+  } catch (const std::runtime_error &) {
+    thrown = true;
+  }
+  CHECK(thrown);
+  CHECK(context.a == 1 && context.b == 1);
+
+  context.fail = false;
+  frame.Run(context);
+  CHECK(context.sumSeen == 4);
+}
+
+int main() {
+  TestOrder();
+  TestWorkersReused();
+  TestWorkerException();
+  return TestResult();
+}
@@ -0,0 +1,131 @@
+// Projectiles hit the first unit along their path however long the step,
+// never fly past their aim point, drop out when they arrive without hitting
+// anything, stay put while their step is zero, and refuse to launch without
+// a positive speed.
+
+#include "Check.hpp"
+#include "Projectiles.hpp"
+
+// A 64 x 64 map of 2-unit cells, hit radius 1, as in the match.
+ProjectilePool Pool() {
+  ProjectilePool pool;
+  pool.Reset(64, 64, 2.0f, 1.0f);
+  return pool;
+}
+
+void TestHit() {
+  ProjectilePool pool = Pool();
+  PositionBuffer units;
+  units.Push(7, {10.0f, 1.0f, 0.0f}, 2u);
+  CHECK(pool.Launch(1, Player::PLAYER1, 2u, {0.0f, 1.0f, 0.0f},
+                    {10.0f, 1.0f, 0.0f}, 20.0f, 5.0f));
+
+  std::vector<ProjectilePool::Hit> hits;
+  pool.Step(0.25f, units, hits);
+  CHECK(hits.empty());
+  CHECK(pool.Size() == 1);
+  pool.Step(0.25f, units, hits);
+  CHECK(hits.size() == 1);
+  CHECK(hits[0].shooter == 1);
+  CHECK(hits[0].target == 7);
+  CHECK(hits[0].team == Player::PLAYER1);
+  CHECK(hits[0].damage == 5.0f);
+  CHECK(pool.Size() == 0);
+}
+
+// One step covering the whole flight, many cells long, still hits the unit
+// half way, and only the first of two on the path.
+void TestLongStep() {
+  ProjectilePool pool = Pool();
+  PositionBuffer units;
+  units.Push(8, {30.0f, 1.0f, 0.5f}, 2u);
+  units.Push(7, {20.0f, 1.0f, -0.5f}, 2u);
+  units.Push(9, {10.0f, 1.0f, 0.0f}, 1u);
+  pool.Launch(1, Player::PLAYER1, 2u, {0.0f, 1.0f, 0.0f},
+              {40.0f, 1.0f, 0.0f}, 24.0f, 5.0f);
+
+  std::vector<ProjectilePool::Hit> hits;
+  pool.Step(10.0f, units, hits);
+  CHECK(hits.size() == 1 && hits[0].target == 7);
+  CHECK(pool.Size() == 0);
+}
+
+// Shots that miss are dropped at their aim point; those still in flight are
+// not.
+void TestArrival() {
+  ProjectilePool pool = Pool();
+  PositionBuffer units;
+  units.Push(7, {10.0f, 1.0f, 4.0f}, 2u);
+  pool.Launch(1, Player::PLAYER1, 2u, {0.0f, 1.0f, 0.0f},
+              {10.0f, 1.0f, 0.0f}, 10.0f, 5.0f);
+  pool.Launch(2, Player::PLAYER1, 2u, {0.0f, 1.0f, 0.0f},
+              {-30.0f, 1.0f, 0.0f}, 10.0f, 5.0f);
+
+  std::vector<ProjectilePool::Hit> hits;
+  pool.Step(1.5f, units, hits);
+  CHECK(hits.empty());
+  CHECK(pool.Size() == 1);
+  CHECK(pool.Position(0).x == -15.0f);
+}
+
+// A projectile given no time this step neither moves nor hits, while the
+// other one flies on.
+void TestPerProjectileSteps() {
+  ProjectilePool pool = Pool();
+  PositionBuffer units;
+  units.Push(7, {4.0f, 1.0f, 0.0f}, 2u);
+  pool.Launch(1, Player::PLAYER1, 2u, {0.0f, 1.0f, 0.0f},
+              {10.0f, 1.0f, 0.0f}, 10.0f, 5.0f);
+  pool.Launch(2, Player::PLAYER1, 2u, {0.0f, 1.0f, 20.0f},
+              {10.0f, 1.0f, 20.0f}, 10.0f, 5.0f);
+
+  std::vector<ProjectilePool::Hit> hits;
+  pool.Step(std::vector<float>{0.0f, 0.5f}, units, hits);
+  CHECK(hits.empty());
+  CHECK(pool.Size() == 2);
+  CHECK(pool.Position(0).x == 0.0f);
+  CHECK(pool.Position(1).x == 5.0f);
+
+  pool.Step(std::vector<float>{0.5f, 0.0f}, units, hits);
+  CHECK(hits.size() == 1 && hits[0].shooter == 1);
+  CHECK(pool.Size() == 1);
+  CHECK(pool.Position(0).x == 5.0f);
+}
+
+// A last move longer than the flight left ends at the aim point: a longer
+// shot sets moves of 0.1 s, and the first shot's 11th has 0.05 s to fly, so
+// it must not reach the unit behind its aim point.
+void TestStopsAtAimPoint() {
+  ProjectilePool pool = Pool();
+  PositionBuffer units;
+  units.Push(7, {11.8f, 1.0f, 0.0f}, 2u);
+  pool.Launch(1, Player::PLAYER1, 2u, {0.0f, 1.0f, 0.0f},
+              {10.5f, 1.0f, 0.0f}, 10.0f, 5.0f);
+  pool.Launch(2, Player::PLAYER1, 2u, {0.0f, 1.0f, 20.0f},
+              {-30.0f, 1.0f, 20.0f}, 10.0f, 5.0f);
+
+  std::vector<ProjectilePool::Hit> hits;
+  pool.Step(1.5f, units, hits);
+  CHECK(hits.empty());
+  CHECK(pool.Size() == 1);
+  CHECK(pool.Position(0).x == -15.0f);
+}
+
+void TestRejectsSpeed() {
+  ProjectilePool pool = Pool();
+  for (float speed : {0.0f, -1.0f, INFINITY, NAN}) {
+    CHECK(!pool.Launch(1, Player::PLAYER1, 2u, {0.0f, 1.0f, 0.0f},
+                       {10.0f, 1.0f, 0.0f}, speed, 5.0f));
+  }
+  CHECK(pool.Size() == 0);
+}
+
+int main() {
+  TestHit();
+  TestLongStep();
+  TestArrival();
+  TestPerProjectileSteps();
+  TestStopsAtAimPoint();
+  TestRejectsSpeed();
+  return TestResult();
+}
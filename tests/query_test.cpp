@@ -0,0 +1,125 @@
+// Persistent queries: how they follow component assignment and entity
+// removal after the first call built them, and that the order of the types
+// asked for does not matter.
+
+#include "Check.hpp"
+#include "ECS.hpp"
+
+std::vector<EntityId> Ids(std::initializer_list<EntityId> ids) {
+  return std::vector<EntityId>(ids);
+}
+
+// An entity joins once its last missing component is assigned, not before.
+void TestAssignCompletes() {
+  Scene scene;
+  EntityId entity = scene.NewEntity();
+  scene.AssignEntity<HealthET>(entity, 10.0f);
+  CHECK(scene.Query<HealthET, PlayerET>().empty());
+
+  scene.AssignEntity<PlayerET>(entity, Player::PLAYER1);
+  CHECK(scene.Query<HealthET, PlayerET>() == Ids({entity}));
+
+  // Assigning it again does not add it twice.
+  scene.AssignEntity<PlayerET>(entity, Player::PLAYER2);
+  CHECK(scene.Query<HealthET, PlayerET>() == Ids({entity}));
+}
+
+void TestAssignBatch() {
+  Scene scene;
+  CHECK(scene.Query<HealthET, PlayerET>().empty());
+  std::vector<EntityId> batch = scene.NewEntities(4);
+  scene.AssignBatch<HealthET>(batch, HealthET(10.0f));
+  CHECK(scene.Query<HealthET, PlayerET>().empty());
+  CHECK(scene.Query<HealthET>() == batch);
+
+  scene.AssignBatch<PlayerET>(batch, PlayerET(Player::PLAYER1));
+  CHECK(scene.Query<HealthET, PlayerET>() == batch);
+}
+
+// Removals are dropped lazily but never show up in a read, including the
+// first read after an assignment that compacts on its own.
+void TestRemove() {
+  Scene scene;
+  std::vector<EntityId> batch = scene.NewEntities(6);
+  scene.AssignBatch<HealthET>(batch, HealthET(10.0f));
+  CHECK(scene.Query<HealthET>().size() == 6);
+
+  scene.RemoveEntity(batch[1]);
+  CHECK(scene.Query<HealthET>() ==
+        Ids({batch[0], batch[2], batch[3], batch[4], batch[5]}));
+
+  scene.RemoveEntities({batch[0], batch[4]});
+  scene.RemoveEntity(batch[4]);
+  EntityId late = scene.NewEntity();
+  scene.AssignEntity<HealthET>(late, 1.0f);
+  CHECK(scene.Query<HealthET>() == Ids({batch[2], batch[3], batch[5], late}));
+
+  // Removing what is not there changes nothing.
+  scene.RemoveEntities({batch[1], 1000});
+  CHECK(scene.Query<HealthET>().size() == 4);
+}
+
+// Tile batches of a chunk that loads later get lower ids than units spawned
+// meanwhile when the ids were handed out first; matches stays ascending.
+void TestLowerIdsJoinLater() {
+  Scene scene;
+  std::vector<EntityId> tiles = scene.NewEntities(3);
+  EntityId unit = scene.NewEntity();
+  scene.AssignEntity<TransformET>(unit, Vector3{0.0f, 0.0f, 0.0f});
+  CHECK(scene.Query<TransformET>() == Ids({unit}));
+
+  scene.AssignBatch<TransformET>(
+      {tiles[2], tiles[0]},
+      std::vector<TransformET>(2, TransformET({1.0f, 0.0f, 0.0f})));
+  scene.AssignEntity<TransformET>(tiles[1], Vector3{2.0f, 0.0f, 0.0f});
+  CHECK(scene.Query<TransformET>() ==
+        Ids({tiles[0], tiles[1], tiles[2], unit}));
+}
+
+// Entities removed while the result is being walked are still visited once
+// by that walk and gone from the next read.
+void TestRemoveWhileIterating() {
+  Scene scene;
+  std::vector<EntityId> batch = scene.NewEntities(5);
+  scene.AssignBatch<HealthET>(batch, HealthET(10.0f));
+
+  std::vector<EntityId> visited;
+  for (EntityId entity : scene.Query<HealthET>()) {
+    visited.push_back(entity);
+    if (entity % 2 == 0) {
+      scene.RemoveEntity(entity);
+    }
+  }
+  CHECK(visited == batch);
+  CHECK(scene.Query<HealthET>() == Ids({batch[1], batch[3]}));
+}
+
+// Query<A, B> and Query<B, A> are the same query.
+void TestSignatureOrder() {
+  Scene scene;
+  std::vector<EntityId> batch = scene.NewEntities(3);
+  scene.AssignBatch<HealthET>(batch, HealthET(10.0f));
+  scene.AssignBatch<PlayerET>(batch, PlayerET(Player::PLAYER1));
+
+  const auto &forward = scene.Query<HealthET, PlayerET>();
+  const auto &backward = scene.Query<PlayerET, HealthET>();
+  CHECK(&forward == &backward);
+
+  std::size_t tracked = 0;
+  for (const auto &entry : scene.GetMemoryReport().subsystems) {
+    if (entry.name == "Scene.persistentQueries") {
+      tracked = entry.count;
+    }
+  }
+  CHECK(tracked == 3);
+}
+
+int main() {
+  TestAssignCompletes();
+  TestAssignBatch();
+  TestRemove();
+  TestLowerIdsJoinLater();
+  TestRemoveWhileIterating();
+  TestSignatureOrder();
+  return TestResult();
+}
@@ -0,0 +1,152 @@
+// Spectator encoding: which chunks get deltas and keyframes and what they
+// hold, and when a spectator is sent what.
+
+#include "Check.hpp"
+#include "SpectatorFeed.hpp"
+#include "TestMaps.hpp"
+#include <cstdio>
+
+struct Decoded {
+  SpectatorMessage type;
+  uint32_t tick;
+  uint32_t chunk;
+  std::vector<uint32_t> units;
+  std::vector<uint32_t> removed;
+};
+
+template <typename T> T Get(const std::string &bytes, std::size_t &at) {
+  T value;
+  std::memcpy(&value, bytes.data() + at, sizeof(T));
+  at += sizeof(T);
+  return value;
+}
+
+Decoded Decode(const std::string &bytes) {
+  Decoded message;
+  std::size_t at = 0;
+  message.type = static_cast<SpectatorMessage>(Get<uint8_t>(bytes, at));
+  message.tick = Get<uint32_t>(bytes, at);
+  message.chunk = Get<uint32_t>(bytes, at);
+  uint32_t units = Get<uint32_t>(bytes, at);
+  uint32_t removed = Get<uint32_t>(bytes, at);
+  for (uint32_t i = 0; i < units; i++) {
+    message.units.push_back(Get<uint32_t>(bytes, at));
+    at += 2 + 3 * sizeof(float);
+  }
+  for (uint32_t i = 0; i < removed; i++) {
+    message.removed.push_back(Get<uint32_t>(bytes, at));
+  }
+  CHECK(at == bytes.size());
+  return message;
+}
+
+std::vector<std::size_t> NonNull(const std::vector<SpectatorPayload> &list) {
+  std::vector<std::size_t> chunks;
+  for (std::size_t i = 0; i < list.size(); i++) {
+    if (list[i])
+      chunks.push_back(i);
+  }
+  return chunks;
+}
+
+// A 96 x 96 map of 3 x 3 chunks with the reactors in chunks 1 and 7.
+struct Fixture {
+  std::string path = WriteMap("spectator_feed_test", 96);
+  std::unique_ptr<Match> match;
+
+  Fixture() {
+    MatchConfig config;
+    config.mapPath = path;
+    config.cosmetics = false;
+    match = std::make_unique<Match>(config);
+  }
+
+  ~Fixture() { std::remove(path.c_str()); }
+
+  // The world position of the middle of chunk (x, z).
+  Vector3 ChunkCenter(int x, int z) const {
+    return {(x * 32 + 16 - 48) * tileSize, 1.0f, (z * 32 + 16 - 48) * tileSize};
+  }
+};
+
+// Keyframes cover the chunks holding units, after a reset.
+void TestKeyframes() {
+  Fixture fixture;
+  Match &match = *fixture.match;
+  SpectatorEncoder encoder(1);
+  match.UpdateEntities(1.0f / 30.0f);
+  auto frame = encoder.Encode(match);
+  CHECK(frame->chunksX == 3);
+  CHECK(frame->keyframes.size() == 9);
+  CHECK(NonNull(frame->keyframes) == std::vector<std::size_t>({1, 7}));
+  CHECK(frame->reset != nullptr);
+
+  Decoded reset = Decode(*frame->reset);
+  CHECK(reset.type == SpectatorMessage::RESET);
+  CHECK(reset.units.empty() && reset.removed.empty());
+  Decoded keyframe = Decode(*frame->keyframes[1]);
+  CHECK(keyframe.type == SpectatorMessage::KEYFRAME);
+  CHECK(keyframe.chunk == 1 && keyframe.tick == frame->tick);
+  CHECK(keyframe.units ==
+        std::vector<uint32_t>({static_cast<uint32_t>(
+            match.GetReactor(Player::PLAYER1))}));
+}
+
+// Deltas only for chunks that changed; a unit leaving a chunk is removed
+// from it and listed in the next.
+void TestDeltas() {
+  Fixture fixture;
+  Match &match = *fixture.match;
+  SpectatorEncoder encoder(1000);
+  match.UpdateEntities(1.0f / 30.0f);
+  auto frame = encoder.Encode(match);
+  CHECK(frame->keyframes.empty() && !frame->reset);
+  CHECK(NonNull(frame->deltas) == std::vector<std::size_t>({1, 7}));
+
+  EntityId unit = match.CreateAttacker(fixture.ChunkCenter(0, 1),
+                                       Player::PLAYER1);
+  frame = encoder.Encode(match);
+  CHECK(NonNull(frame->deltas) == std::vector<std::size_t>({3}));
+  Decoded spawned = Decode(*frame->deltas[3]);
+  CHECK(spawned.type == SpectatorMessage::DELTA);
+  CHECK(spawned.units == std::vector<uint32_t>({uint32_t(unit)}));
+
+  frame = encoder.Encode(match);
+  CHECK(NonNull(frame->deltas).empty());
+
+  match.GetScene().GetComponent<TransformET>(unit)->position =
+      fixture.ChunkCenter(2, 1);
+  frame = encoder.Encode(match);
+  CHECK(NonNull(frame->deltas) == std::vector<std::size_t>({3, 5}));
+  CHECK(Decode(*frame->deltas[3]).removed ==
+        std::vector<uint32_t>({uint32_t(unit)}));
+  CHECK(Decode(*frame->deltas[5]).units ==
+        std::vector<uint32_t>({uint32_t(unit)}));
+}
+
+// A new or lagging spectator waits for a keyframe tick; deltas stop past
+// the backlog limit and resume with a keyframe once half of it drained.
+void TestAdmit() {
+  SpectatorFrame delta, keyframe;
+  delta.chunksX = keyframe.chunksX = 3;
+  keyframe.keyframes.resize(9);
+  SpectatorView view;
+  using Send = SpectatorView::Send;
+  CHECK(view.Admit(delta, 0, 100) == Send::NOTHING);
+  CHECK(view.Admit(keyframe, 0, 100) == Send::KEYFRAMES);
+  CHECK(view.Admit(delta, 100, 100) == Send::DELTAS);
+  CHECK(view.Admit(delta, 101, 100) == Send::NOTHING);
+  CHECK(view.Admit(keyframe, 60, 100) == Send::NOTHING);
+  CHECK(view.Admit(keyframe, 50, 100) == Send::KEYFRAMES);
+
+  view.Focus(0, 0, 1);
+  CHECK(view.Sees(keyframe, 4) && !view.Sees(keyframe, 2));
+  CHECK(view.Admit(delta, 0, 100) == Send::NOTHING);
+}
+
+int main() {
+  TestKeyframes();
+  TestDeltas();
+  TestAdmit();
+  return TestResult();
+}
@@ -0,0 +1,83 @@
+// Chunk streaming: which chunks of a large map hold tile entities.
+
+#include "Check.hpp"
+#include "Match.hpp"
+#include "TestMaps.hpp"
+#include <algorithm>
+#include <cstdio>
+
+Vector3 CellCenter(const Match &match, int x, int z) {
+  int halfWidth = static_cast<int>(match.GetMap().Width()) / 2;
+  int halfDepth = static_cast<int>(match.GetMap().Depth()) / 2;
+  return {(x - halfWidth) * tileSize, 0.0f, (z - halfDepth) * tileSize};
+}
+
+std::size_t Resident(const Match &match) {
+  return match.GetChunks().Count() -
+         match.GetChunks().CountIn(ChunkState::PAGED_OUT);
+}
+
+std::size_t TileCount(Match &match) {
+  return match.GetScene().Query<TileET>().size();
+}
+
+// Nothing is loaded up front. The first tick loads the 3 x 3 chunks around
+// the focus and the two holding a reactor.
+void TestStartsPagedOut(const std::string &path) {
+  MatchConfig config;
+  config.mapPath = path;
+  Match match(config);
+  CHECK(match.GetChunks().Count() == 64);
+  CHECK(Resident(match) == 0);
+  CHECK(TileCount(match) == 0);
+
+  match.SetFocus(CellCenter(match, 40, 128));
+  match.UpdateEntities(1.0f / 30.0f);
+  CHECK(match.GetChunks().CountIn(ChunkState::ACTIVE) == 9);
+  CHECK(match.GetChunks().CountIn(ChunkState::DORMANT) == 2);
+  CHECK(TileCount(match) == 11 * 32 * 32);
+}
+
+// Without a focus the whole map is active from the first tick on.
+void TestNoFocusLoadsEverything(const std::string &path) {
+  MatchConfig config;
+  config.mapPath = path;
+  Match match(config);
+  match.UpdateEntities(1.0f / 30.0f);
+  CHECK(match.GetChunks().CountIn(ChunkState::ACTIVE) == 64);
+  CHECK(TileCount(match) == 256 * 256);
+}
+
+// Panning the focus corner to corner across a 16 x 16 chunk map keeps the
+// chunks around it and the ones it left less than pageOutTicks ago, never
+// a share of the map that grows with it.
+void TestResidencyWhilePanning() {
+  std::string path = WriteMap("streaming_test", 512);
+  MatchConfig config;
+  config.mapPath = path;
+  config.pageOutTicks = 16;
+  Match match(config);
+  CHECK(match.GetChunks().Count() == 256);
+
+  std::size_t mostResident = 0, mostTiles = 0;
+  for (int cell = 0; cell < 512; cell += 4) {
+    match.SetFocus(CellCenter(match, cell, cell));
+    match.UpdateEntities(1.0f / 30.0f);
+    mostResident = std::max(mostResident, Resident(match));
+    mostTiles = std::max(mostTiles, TileCount(match));
+  }
+  // 9 in view, the 5 the focus left on each of the last two chunk steps
+  // (one every 8 ticks) and the 2 reactor chunks.
+  CHECK(mostResident <= 9 + 2 * 5 + 2);
+  CHECK(mostTiles <= mostResident * 32 * 32);
+  std::remove(path.c_str());
+}
+
+int main() {
+  std::string path = WriteMap("streaming_test", 256);
+  TestStartsPagedOut(path);
+  TestNoFocusLoadsEverything(path);
+  std::remove(path.c_str());
+  TestResidencyWhilePanning();
+  return TestResult();
+}
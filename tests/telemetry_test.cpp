@@ -0,0 +1,91 @@
+// Memory reports: what the counters see and that the JSON they are written
+// as parses back to the same numbers, whatever the names contain.
+
+#include "Check.hpp"
+#include "ECS.hpp"
+
+void TestCounters() {
+  AllocationCounter counter;
+  counter.OnAllocate(100);
+  counter.OnAllocate(50);
+  counter.OnFree(100);
+  CHECK(counter.liveBytes == 50);
+  CHECK(counter.highWaterBytes == 150);
+  CHECK(counter.liveAllocations == 1);
+  CHECK(counter.totalAllocations == 2);
+  CHECK(counter.totalBytes == 150);
+
+  std::vector<int, CountingAllocator<int>> numbers{
+      CountingAllocator<int>(&counter)};
+  numbers.reserve(10);
+  CHECK(counter.liveBytes == 50 + 10 * sizeof(int));
+  numbers = decltype(numbers)(CountingAllocator<int>(&counter));
+  CHECK(counter.liveBytes == 50);
+}
+
+void TestJson() {
+  MemoryReport report;
+  MemoryEntry entry;
+  entry.name = "Odd \"name\"\\\n";
+  entry.count = 3;
+  entry.capacityBytes = 64;
+  entry.allocations.OnAllocate(32);
+  report.subsystems.push_back(entry);
+
+  nlohmann::json parsed = nlohmann::json::parse(report.ToJson());
+  CHECK(parsed["liveBytes"] == 64);
+  CHECK(parsed["components"].empty());
+  CHECK(parsed["subsystems"][0]["name"] == entry.name);
+  CHECK(parsed["subsystems"][0]["count"] == 3);
+  CHECK(parsed["subsystems"][0]["liveBytes"] == 32);
+}
+
+std::size_t TotalAllocations(const MemoryReport &report) {
+  std::size_t total = 0;
+  for (const auto *entries : {&report.components, &report.subsystems}) {
+    for (const MemoryEntry &entry : *entries) {
+      total += entry.allocations.totalAllocations;
+    }
+  }
+  return total;
+}
+
+// Every component is one counted allocation of at least its size. Query
+// results handed to the caller cost the scene nothing; a persistent query
+// is reported with the ids it holds.
+void TestQueryMemory() {
+  Scene scene;
+  for (int i = 0; i < 10; i++) {
+    scene.AssignEntity<HealthET>(scene.NewEntity(), 10.0f);
+  }
+  MemoryReport before = scene.GetMemoryReport();
+  CHECK(before.components.size() == 1);
+  CHECK(before.components[0].count == 10);
+  CHECK(before.components[0].allocations.totalAllocations == 10);
+  CHECK(before.components[0].allocations.liveBytes >= 10 * sizeof(HealthET));
+
+  for (int i = 0; i < 100; i++) {
+    CHECK(scene.GetEntitiesWithComponent<HealthET>().size() == 10);
+  }
+  MemoryReport after = scene.GetMemoryReport();
+  CHECK(after.LiveBytes() == before.LiveBytes());
+  CHECK(after.HighWaterBytes() == before.HighWaterBytes());
+  CHECK(TotalAllocations(after) == TotalAllocations(before));
+
+  CHECK(scene.Query<HealthET>().size() == 10);
+  after = scene.GetMemoryReport();
+  for (const auto &entry : after.subsystems) {
+    if (entry.name == "Scene.persistentQueries") {
+      CHECK(entry.count == 10);
+      CHECK(entry.capacityBytes >= 10 * sizeof(EntityId));
+    }
+  }
+  CHECK(after.LiveBytes() >= before.LiveBytes() + 10 * sizeof(EntityId));
+}
+
+int main() {
+  TestCounters();
+  TestJson();
+  TestQueryMemory();
+  return TestResult();
+}
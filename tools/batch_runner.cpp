@@ -0,0 +1,262 @@
+// Headless batch-match runner for balance sweeps.
+//
+//   batch_runner <sweep.json> [output.json]
+//
+// Every combination of the values listed under "sweep" is played
+// "matchesPerConfig" times by two scripted bots, spread over all cores, on the
+// cooked "map" if one is given. The aggregated win rates and match lengths are
+// written as JSON.
+//
+// Match i of every combination is seeded with "seed" + i, so all of them are
+// played on the same seeds and differ only in the swept values.
+
+#include "Bot.hpp"
+#include "Match.hpp"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <nlohmann/json.hpp>
+#include <thread>
+
+using json = nlohmann::json;
+
+using ConfigSetter = std::function<void(MatchConfig &, const json &)>;
+
+const std::vector<std::pair<std::string, ConfigSetter>> SWEEP_PARAMETERS = {
+    {"startingPoints",
+     [](MatchConfig &c, const json &v) { c.startingPoints = v; }},
+    {"attackerCost", [](MatchConfig &c, const json &v) { c.attackerCost = v; }},
+    {"wallCost", [](MatchConfig &c, const json &v) { c.wallCost = v; }},
+    {"portalCost", [](MatchConfig &c, const json &v) { c.portalCost = v; }},
+    {"attackerDamage",
+     [](MatchConfig &c, const json &v) { c.attackerDamage = v; }},
+    {"attackerRange",
+     [](MatchConfig &c, const json &v) { c.attackerRange = v; }},
+    {"attackerCooldown",
+     [](MatchConfig &c, const json &v) { c.attackerCooldown = v; }},
+    {"attackerHealth",
+     [](MatchConfig &c, const json &v) { c.attackerHealth = v; }},
+    {"wallDefense", [](MatchConfig &c, const json &v) { c.wallDefense = v; }},
+    {"wallBlockChance",
+     [](MatchConfig &c, const json &v) { c.wallBlockChance = v; }},
+    {"wallHealth", [](MatchConfig &c, const json &v) { c.wallHealth = v; }},
+    {"reactorHealth",
+     [](MatchConfig &c, const json &v) { c.reactorHealth = v; }},
+    {"fogOfWar", [](MatchConfig &c, const json &v) { c.fogOfWar = v; }},
+    {"sightRadius", [](MatchConfig &c, const json &v) { c.sightRadius = v; }},
+    {"lineOfSight", [](MatchConfig &c, const json &v) { c.lineOfSight = v; }},
+    {"projectiles", [](MatchConfig &c, const json &v) { c.projectiles = v; }},
+};
+
+struct SweepPoint {
+  MatchConfig config;
+  json parameters;
+};
+
+struct MatchResult {
+  std::optional<Player> winner;
+  long ticks;
+  std::size_t highWaterBytes;
+};
+
+BotProfile ParseBotProfile(const json &node) {
+  BotProfile profile;
+  profile.aggression = node.value("aggression", profile.aggression);
+  profile.portalChance = node.value("portalChance", profile.portalChance);
+  profile.decisionInterval =
+      node.value("decisionInterval", profile.decisionInterval);
+  return profile;
+}
+
+// Expands the "sweep" object into the cartesian product of its value lists.
+std::vector<SweepPoint> ExpandSweep(const json &sweep) {
+  std::vector<SweepPoint> points = {{MatchConfig(), json::object()}};
+
+  for (const auto &[name, setter] : SWEEP_PARAMETERS) {
+    if (!sweep.contains(name))
+      continue;
+
+    json values =
+        sweep[name].is_array() ? sweep[name] : json::array({sweep[name]});
+    std::vector<SweepPoint> expanded;
+    for (const auto &point : points) {
+      for (const auto &value : values) {
+        SweepPoint next = point;
+        setter(next.config, value);
+        next.parameters[name] = value;
+        expanded.push_back(next);
+      }
+    }
+    points = std::move(expanded);
+  }
+
+  for (const auto &item : sweep.items()) {
+    bool known = std::any_of(SWEEP_PARAMETERS.begin(), SWEEP_PARAMETERS.end(),
+                             [&item](const auto &parameter) {
+                               return parameter.first == item.key();
+                             });
+    if (!known) {
+      std::cerr << "Ignoring unknown sweep parameter: " << item.key() << "\n";
+    }
+  }
+  return points;
+}
+
+// Nobody can afford anything and nobody has fired for quietTicks: attackers
+// never move, so the match can only end in a draw.
+bool IsStalemate(Match &match, long quietTicks) {
+  const MatchConfig &config = match.GetConfig();
+  int cheapest =
+      std::min({config.attackerCost, config.wallCost, config.portalCost});
+  return match.GetPoints(Player::PLAYER1) < cheapest &&
+         match.GetPoints(Player::PLAYER2) < cheapest &&
+         match.GetTick() - match.GetLastAttackTick() > quietTicks;
+}
+
+MatchResult PlayMatch(MatchConfig config, const BotProfile &player1,
+                      const BotProfile &player2, long maxTicks,
+                      float deltaTime) {
+  config.cosmetics = false;
+  Match match(config);
+  ScriptedBot bot1(Player::PLAYER1, player1, config.seed * 2 + 1);
+  ScriptedBot bot2(Player::PLAYER2, player2, config.seed * 2 + 2);
+
+  while (match.GetTick() < maxTicks) {
+    bot1.Update(match, deltaTime);
+    bot2.Update(match, deltaTime);
+    match.UpdateEntities(deltaTime);
+
+    std::optional<Player> winner = match.GetWinner();
+    if (winner || IsStalemate(match, static_cast<long>(10.0f / deltaTime))) {
+      return {winner, match.GetTick(),
+              match.GetMemoryReport().HighWaterBytes()};
+    }
+  }
+  return {std::nullopt, match.GetTick(),
+          match.GetMemoryReport().HighWaterBytes()};
+}
+
+json Summarize(const SweepPoint &point, std::vector<MatchResult> results,
+               float tickRate) {
+  std::size_t player1Wins = 0, player2Wins = 0, highWaterBytes = 0;
+  double totalTicks = 0;
+  for (const auto &result : results) {
+    player1Wins += result.winner == Player::PLAYER1;
+    player2Wins += result.winner == Player::PLAYER2;
+    totalTicks += result.ticks;
+    highWaterBytes = std::max(highWaterBytes, result.highWaterBytes);
+  }
+
+  std::sort(results.begin(), results.end(),
+            [](const MatchResult &a, const MatchResult &b) {
+              return a.ticks < b.ticks;
+            });
+  auto percentile = [&results, tickRate](double p) {
+    std::size_t index = static_cast<std::size_t>(p * (results.size() - 1));
+    return results[index].ticks / tickRate;
+  };
+
+  double count = static_cast<double>(results.size());
+  return {
+      {"parameters", point.parameters},
+      {"matches", results.size()},
+      {"player1WinRate", player1Wins / count},
+      {"player2WinRate", player2Wins / count},
+      {"drawRate", (count - player1Wins - player2Wins) / count},
+      {"matchSeconds",
+       {{"mean", totalTicks / count / tickRate},
+        {"min", results.front().ticks / tickRate},
+        {"p50", percentile(0.5)},
+        {"p90", percentile(0.9)},
+        {"max", results.back().ticks / tickRate}}},
+      {"highWaterBytes", highWaterBytes},
+  };
+}
+
+int main(int argc, char **argv) {
+  if (argc < 2) {
+    std::cerr << "usage: " << argv[0] << " <sweep.json> [output.json]\n";
+    return 1;
+  }
+
+  std::ifstream configFile(argv[1]);
+  if (!configFile) {
+    std::cerr << "Cannot open " << argv[1] << "\n";
+    return 1;
+  }
+
+  json root;
+  try {
+    root = json::parse(configFile);
+  } catch (const json::exception &e) {
+    std::cerr << argv[1] << ": " << e.what() << "\n";
+    return 1;
+  }
+
+  int matchesPerConfig = root.value("matchesPerConfig", 100);
+  float tickRate = root.value("tickRate", 60.0f);
+  long maxTicks =
+      static_cast<long>(root.value("maxSeconds", 600.0f) * tickRate);
+  unsigned baseSeed = root.value("seed", 1u);
+  std::string mapPath = root.value("map", std::string());
+  int defaultThreads =
+      static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+  int threadCount = root.value("threads", defaultThreads);
+  BotProfile player1 = ParseBotProfile(root.value("player1", json::object()));
+  BotProfile player2 = ParseBotProfile(root.value("player2", json::object()));
+
+  if (matchesPerConfig <= 0 || tickRate <= 0.0f || threadCount <= 0) {
+    std::cerr << "matchesPerConfig, tickRate and threads must be positive\n";
+    return 1;
+  }
+
+  std::vector<SweepPoint> points =
+      ExpandSweep(root.value("sweep", json::object()));
+  std::size_t totalMatches = points.size() * matchesPerConfig;
+  std::vector<MatchResult> results(totalMatches);
+  std::atomic<std::size_t> nextMatch{0};
+
+  auto started = std::chrono::steady_clock::now();
+  std::vector<std::thread> workers;
+  for (int i = 0; i < threadCount; i++) {
+    workers.emplace_back([&]() {
+      for (std::size_t job = nextMatch++; job < totalMatches;
+           job = nextMatch++) {
+        MatchConfig config = points[job / matchesPerConfig].config;
+        config.seed = baseSeed + static_cast<unsigned>(job % matchesPerConfig);
+        config.mapPath = mapPath;
+        results[job] =
+            PlayMatch(config, player1, player2, maxTicks, 1.0f / tickRate);
+      }
+    });
+  }
+  for (auto &worker : workers) {
+    worker.join();
+  }
+  double elapsed = std::chrono::duration<double>(
+                       std::chrono::steady_clock::now() - started)
+                       .count();
+
+  json report = json::array();
+  for (std::size_t i = 0; i < points.size(); i++) {
+    auto first = results.begin() + i * matchesPerConfig;
+    report.push_back(Summarize(
+        points[i], std::vector<MatchResult>(first, first + matchesPerConfig),
+        tickRate));
+  }
+
+  std::fprintf(stderr, "%zu matches on %d threads in %.1fs (%.0f/min)\n",
+               totalMatches, threadCount, elapsed,
+               totalMatches / elapsed * 60.0);
+
+  if (argc > 2) {
+    std::ofstream(argv[2]) << report.dump(2) << "\n";
+  } else {
+    std::cout << report.dump(2) << "\n";
+  }
+  return 0;
+}
@@ -0,0 +1,337 @@
+// Micro-benchmarks for the hot paths of the match.
+//
+//   bench [name...]
+//
+// Runs the named benchmarks, or all of them. Every case is timed over several
+// runs and the median is printed, so one slow run does not skew it. Numbers
+// only mean something in an optimised build (CMAKE_BUILD_TYPE=Release).
+// Exits non-zero when a benchmark with a budget goes over it.
+
+#include "Match.hpp"
+#include "SpectatorFeed.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <random>
+#include <vector>
+
+using Clock = std::chrono::steady_clock;
+
+// Median milliseconds of run over runs calls; setup is not timed.
+template <typename Setup, typename Run>
+double MedianMs(int runs, Setup setup, Run run) {
+  std::vector<double> times;
+  for (int i = 0; i < runs; i++) {
+    setup();
+    auto started = Clock::now();
+    run();
+    times.push_back(
+        std::chrono::duration<double, std::milli>(Clock::now() - started)
+            .count());
+  }
+  std::sort(times.begin(), times.end());
+  return times[times.size() / 2];
+}
+
+std::size_t TableAllocations(const Scene &scene) {
+  for (const auto &entry : scene.GetMemoryReport().subsystems) {
+    if (entry.name == "Scene.componentTables")
+      return entry.allocations.totalAllocations;
+  }
+  return 0;
+}
+
+// A 10k attacker wave through SpawnBatch against one entity and one
+// AssignEntity per component at a time.
+bool BenchSpawn() {
+  const std::size_t count = 10000;
+  Prefab prefab;
+  prefab.With<RenderableET>(BLUE, EntityType::ATTACKER, 2.0f, 2.0f)
+      .With<AttackerET>(10.0f, 16.0f, 1.0f)
+      .With<HealthET>(50.0f)
+      .With<PlayerET>(Player::PLAYER1);
+  std::vector<Vector3> positions(count, Vector3{0.0f, 1.0f, 0.0f});
+
+  std::unique_ptr<Scene> scene;
+  auto fresh = [&scene]() { scene = std::make_unique<Scene>(); };
+
+  double batched = MedianMs(9, fresh, [&]() {
+    SpawnBatch(*scene, prefab, positions);
+  });
+  std::size_t batchedAllocations = TableAllocations(*scene);
+
+  double single = MedianMs(9, fresh, [&]() {
+    for (const Vector3 &position : positions) {
+      EntityId entity = scene->NewEntity();
+      scene->AssignEntity<TransformET>(entity, position);
+      scene->AssignEntity<RenderableET>(entity, BLUE, EntityType::ATTACKER,
+                                        2.0f, 2.0f);
+      scene->AssignEntity<AttackerET>(entity, 10.0f, 16.0f, 1.0f);
+      scene->AssignEntity<HealthET>(entity, 50.0f);
+      scene->AssignEntity<PlayerET>(entity, Player::PLAYER1);
+    }
+  });
+  std::size_t singleAllocations = TableAllocations(*scene);
+
+  std::printf("spawn %zu: batch %.2f ms (%zu table allocations), "
+              "one by one %.2f ms (%zu)\n",
+              count, batched, batchedAllocations, single, singleAllocations);
+  return true;
+}
+
+// Nearest-target and in-range queries over 100k candidates, half of them on
+// the searching team, for every kernel the CPU supports, against the loop
+// with a sqrt per candidate that the kernels replaced.
+bool BenchDistance() {
+  const std::size_t count = 100000;
+  const int queries = 100;
+  std::mt19937 rng(1);
+  std::uniform_real_distribution<float> coordinate(-100.0f, 100.0f);
+  PositionBuffer buffer;
+  for (std::size_t i = 0; i < count; i++) {
+    buffer.Push(i, {coordinate(rng), coordinate(rng), coordinate(rng)},
+                i % 2 ? 1u : 2u);
+  }
+  std::vector<Vector3> origins;
+  for (int i = 0; i < queries; i++) {
+    origins.push_back({coordinate(rng), coordinate(rng), coordinate(rng)});
+  }
+  std::vector<uint8_t> inside(count);
+  // Keeps the results alive so the loops are not optimised away.
+  volatile std::ptrdiff_t sink = 0;
+
+  double sqrtLoop = MedianMs(9, []() {}, [&]() {
+    for (const Vector3 &origin : origins) {
+      std::ptrdiff_t best = -1;
+      float bestDistance = INFINITY;
+      for (std::size_t i = 0; i < count; i++) {
+        if (!(buffer.teamBits[i] & 1u))
+          continue;
+        float dx = buffer.x[i] - origin.x;
+        float dy = buffer.y[i] - origin.y;
+        float dz = buffer.z[i] - origin.z;
+        float distance = std::sqrt(dx * dx + dy * dy + dz * dz);
+        if (distance < bestDistance) {
+          bestDistance = distance;
+          best = static_cast<std::ptrdiff_t>(i);
+        }
+      }
+      sink = best;
+    }
+  });
+  std::printf("distance %zu x %d queries: nearest with sqrt %.2f ms\n", count,
+              queries, sqrtLoop);
+
+  std::vector<kernels::DistanceKernelTable> tables = {
+      {"scalar", kernels::SquaredDistancesFallback, kernels::NearestFallback,
+       kernels::WithinRadiusFallback, kernels::WithinSquareFallback}};
+#ifdef MIH_X86_KERNELS
+  if (__builtin_cpu_supports("sse2")) {
+    tables.push_back({"sse2", kernels::SquaredDistancesSSE,
+                      kernels::NearestSSE, kernels::WithinRadiusSSE,
+                      kernels::WithinSquareSSE});
+  }
+  if (__builtin_cpu_supports("avx2")) {
+    tables.push_back({"avx2", kernels::SquaredDistancesAVX2,
+                      kernels::NearestAVX2, kernels::WithinRadiusAVX2,
+                      kernels::WithinSquareAVX2});
+  }
+#endif
+
+  double scalarNearest = 0.0, scalarRadius = 0.0;
+  for (const auto &table : tables) {
+    double nearest = MedianMs(9, []() {}, [&]() {
+      for (const Vector3 &origin : origins) {
+        sink = table.nearest(buffer, origin, 1u, nullptr);
+      }
+    });
+    double radius = MedianMs(9, []() {}, [&]() {
+      for (const Vector3 &origin : origins) {
+        table.withinRadius(buffer, origin, 16.0f * 16.0f, 1u, inside.data());
+        sink = inside[count / 2];
+      }
+    });
+    if (scalarNearest == 0.0) {
+      scalarNearest = nearest;
+      scalarRadius = radius;
+    }
+    std::printf("  %-6s nearest %.2f ms (%.1fx scalar, %.1fx sqrt), "
+                "within radius %.2f ms (%.1fx scalar)\n",
+                table.name, nearest, scalarNearest / nearest,
+                sqrtLoop / nearest, radius, scalarRadius / radius);
+  }
+  return true;
+}
+
+// What spectators cost the simulation thread: encoding a tick in which 10k
+// units all moved, as deltas and as keyframes. Sending happens on the
+// server's network thread and does not depend on this; measuring it takes
+// spectator_server and spectator_load.
+bool BenchSpectator() {
+  const std::size_t count = 10000;
+  MatchConfig config;
+  config.cosmetics = false;
+  Match match(config);
+  std::vector<Vector3> positions;
+  for (std::size_t i = 0; i < count; i++) {
+    positions.push_back({static_cast<float>(i % 16) - 8.0f, 1.0f,
+                         static_cast<float>(i / 16 % 16) - 8.0f});
+  }
+  std::vector<EntityId> units =
+      match.SpawnAttackerWave(positions, Player::PLAYER1);
+  match.UpdateEntities(1.0f / 30.0f);
+
+  auto moveAll = [&]() {
+    for (EntityId unit : units) {
+      match.GetScene().GetComponent<TransformET>(unit)->position.x += 0.01f;
+    }
+  };
+  std::size_t bytes = 0;
+  auto frameBytes = [](const SpectatorFrame &frame) {
+    std::size_t total = frame.reset ? frame.reset->size() : 0;
+    for (const auto *list : {&frame.deltas, &frame.keyframes}) {
+      for (const auto &payload : *list) {
+        total += payload ? payload->size() : 0;
+      }
+    }
+    return total;
+  };
+
+  SpectatorEncoder deltas(1 << 30);
+  deltas.Encode(match);
+  double delta = MedianMs(9, moveAll, [&]() {
+    bytes = frameBytes(*deltas.Encode(match));
+  });
+  std::printf("spectator %zu moving units: delta tick %.2f ms (%zu bytes)",
+              count, delta, bytes);
+
+  SpectatorEncoder keyframes(1);
+  double keyframe = MedianMs(9, moveAll, [&]() {
+    bytes = frameBytes(*keyframes.Encode(match));
+  });
+  std::printf(", keyframe tick %.2f ms (%zu bytes)\n", keyframe, bytes);
+  return true;
+}
+
+// A tick of 10k projectiles in flight among 10k units on a 256 x 256 map:
+// moving them and resolving hits, at the game's usual frame length and at a
+// frame long enough to need several moves.
+bool BenchProjectiles() {
+  const std::size_t count = 10000;
+  const int mapSize = 256;
+  const float extent = mapSize * tileSize / 2 - 1.0f;
+  std::mt19937 rng(1);
+  std::uniform_real_distribution<float> coordinate(-extent, extent);
+  PositionBuffer units;
+  for (std::size_t i = 0; i < count; i++) {
+    units.Push(i, {coordinate(rng), 1.0f, coordinate(rng)}, i % 2 ? 1u : 2u);
+  }
+
+  ProjectilePool pool;
+  std::vector<ProjectilePool::Hit> hits;
+  auto launch = [&]() {
+    pool.Reset(mapSize, mapSize, tileSize, tileSize / 2);
+    hits.clear();
+    for (std::size_t i = 0; i < count; i++) {
+      Vector3 start = {coordinate(rng), 1.0f, coordinate(rng)};
+      Vector3 aim = {start.x + 16.0f, 1.0f, start.z};
+      pool.Launch(i, i % 2 ? Player::PLAYER1 : Player::PLAYER2,
+                  i % 2 ? 2u : 1u, start, aim, 24.0f, 1.0f);
+    }
+  };
+
+  std::printf("projectiles %zu among %zu units:", count, count);
+  for (float frame : {1.0f / 60.0f, 0.25f}) {
+    double step = MedianMs(9, launch, [&]() {
+      pool.Step(frame, units, hits);
+    });
+    std::printf(" %.0f ms frame %.2f ms (%zu hits)", frame * 1000.0f, step,
+                hits.size());
+  }
+  std::printf("\n");
+  return true;
+}
+
+// What a match of 50k entities holds: 40k tiles of a 200 x 200 map and 5k
+// attackers a side along a front, after a second of fighting, long enough
+// for every attacker's cooldown to come up. Printed as the memory report's
+// JSON and held to MEMORY_BUDGET; raise the budget in the same change as
+// whatever needs more.
+struct MemoryBudget {
+  std::size_t liveBytes;
+  std::size_t highWaterBytes;
+  std::size_t totalAllocations;
+};
+// About a tenth above what the match needed when the budget was last set.
+const MemoryBudget MEMORY_BUDGET = {33000000, 33000000, 320};
+
+bool BenchMemory() {
+  const char *mapPath = "bench_memory.mihm";
+  std::vector<uint8_t> bytes = CookMap(DefaultMapSource(200));
+  std::ofstream(mapPath, std::ios::binary)
+      .write(reinterpret_cast<const char *>(bytes.data()), bytes.size());
+
+  MatchConfig config;
+  config.mapPath = mapPath;
+  config.cosmetics = false;
+  Match match(config);
+  for (Player side : {Player::PLAYER1, Player::PLAYER2}) {
+    float direction = side == Player::PLAYER1 ? -1.0f : 1.0f;
+    std::vector<Vector3> positions;
+    for (int i = 0; i < 5000; i++) {
+      positions.push_back({(i % 100 - 50) * tileSize, 1.0f,
+                           direction * (i / 100 + 2) * tileSize});
+    }
+    match.SpawnAttackerWave(positions, side);
+  }
+  for (int tick = 0; tick < 30; tick++) {
+    match.UpdateEntities(1.0f / 30.0f);
+  }
+  std::remove(mapPath);
+
+  MemoryReport report = match.GetMemoryReport();
+  std::size_t allocations = 0;
+  for (const auto *entries : {&report.components, &report.subsystems}) {
+    for (const MemoryEntry &entry : *entries) {
+      allocations += entry.allocations.totalAllocations;
+    }
+  }
+  std::printf("memory %zu entities: %s\n", match.GetScene().GetAllEntities().size(),
+              report.ToJson().c_str());
+  std::printf("memory live %zu bytes (budget %zu), high water %zu (%zu), "
+              "allocations %zu (%zu)\n",
+              report.LiveBytes(), MEMORY_BUDGET.liveBytes,
+              report.HighWaterBytes(), MEMORY_BUDGET.highWaterBytes,
+              allocations, MEMORY_BUDGET.totalAllocations);
+  return report.LiveBytes() <= MEMORY_BUDGET.liveBytes &&
+         report.HighWaterBytes() <= MEMORY_BUDGET.highWaterBytes &&
+         allocations <= MEMORY_BUDGET.totalAllocations;
+}
+
+using Benchmark = std::pair<const char *, std::function<bool()>>;
+
+const std::vector<Benchmark> BENCHMARKS = {
+    {"spawn", BenchSpawn},
+    {"distance", BenchDistance},
+    {"spectator", BenchSpectator},
+    {"projectiles", BenchProjectiles},
+    {"memory", BenchMemory},
+};
+
+int main(int argc, char **argv) {
+  bool withinBudget = true;
+  for (const auto &[name, bench] : BENCHMARKS) {
+    bool wanted = argc < 2;
+    for (int i = 1; i < argc; i++) {
+      wanted = wanted || std::strcmp(argv[i], name) == 0;
+    }
+    if (wanted && !bench()) {
+      std::printf("%s: over budget\n", name);
+      withinBudget = false;
+    }
+  }
+  return withinBudget ? 0 : 1;
+}
@@ -0,0 +1,38 @@
+// Cooks a JSON map description into the binary format the game memory-maps.
+//
+//   map_cooker <map.json> <map.mihm>
+//
+// See MapCooker.hpp for the format of the description.
+
+#include "MapCooker.hpp"
+#include <fstream>
+#include <iostream>
+
+int main(int argc, char **argv) {
+  if (argc < 3) {
+    std::cerr << "usage: " << argv[0] << " <map.json> <map.mihm>\n";
+    return 1;
+  }
+
+  std::ifstream input(argv[1]);
+  if (!input) {
+    std::cerr << "Cannot open " << argv[1] << "\n";
+    return 1;
+  }
+
+  std::vector<uint8_t> cooked;
+  try {
+    cooked = CookMap(ParseMap(json::parse(input)));
+  } catch (const std::exception &e) {
+    std::cerr << argv[1] << ": " << e.what() << "\n";
+    return 1;
+  }
+
+  std::ofstream output(argv[2], std::ios::binary);
+  output.write(reinterpret_cast<const char *>(cooked.data()), cooked.size());
+  if (!output) {
+    std::cerr << "Cannot write " << argv[2] << "\n";
+    return 1;
+  }
+  return 0;
+}
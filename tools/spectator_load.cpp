@@ -0,0 +1,60 @@
+// Opens many spectator connections to a spectator_server and reports what
+// they receive.
+//
+//   spectator_load [count] [uri] [focus radius]
+//
+// With a focus radius every connection watches the chunks around a different
+// chunk of the first row instead of the whole map.
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <websocketpp/client.hpp>
+#include <websocketpp/config/asio_no_tls_client.hpp>
+
+using WsClient = websocketpp::client<websocketpp::config::asio_client>;
+
+int main(int argc, char **argv) {
+  int count = argc > 1 ? std::atoi(argv[1]) : 1000;
+  std::string uri = argc > 2 ? argv[2] : "ws://localhost:9002";
+  int radius = argc > 3 ? std::atoi(argv[3]) : -1;
+
+  std::atomic<std::size_t> open{0}, messages{0}, bytes{0};
+  WsClient client;
+  client.clear_access_channels(websocketpp::log::alevel::all);
+  client.clear_error_channels(websocketpp::log::elevel::all);
+  client.init_asio();
+  client.set_message_handler(
+      [&](websocketpp::connection_hdl, WsClient::message_ptr message) {
+        messages++;
+        bytes += message->get_payload().size();
+      });
+
+  for (int i = 0; i < count; i++) {
+    websocketpp::lib::error_code error;
+    WsClient::connection_ptr connection = client.get_connection(uri, error);
+    if (error) {
+      std::fprintf(stderr, "%s: %s\n", uri.c_str(), error.message().c_str());
+      return 1;
+    }
+    connection->set_open_handler([&, i](websocketpp::connection_hdl handle) {
+      open++;
+      if (radius >= 0) {
+        std::string focus = "focus " + std::to_string(i % 8) + " 0 " +
+                            std::to_string(radius);
+        client.send(handle, focus, websocketpp::frame::opcode::text);
+      }
+    });
+    client.connect(connection);
+  }
+
+  std::thread network([&client]() { client.run(); });
+  for (;;) {
+    std::this_thread::sleep_for(std::chrono::seconds(1));
+    std::printf("%zu open, %zu messages/s, %.1f KiB/s\n", open.load(),
+                messages.exchange(0), bytes.exchange(0) / 1024.0);
+  }
+}
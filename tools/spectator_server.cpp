@@ -0,0 +1,83 @@
+// Plays scripted bot matches in real time and streams them to spectators.
+//
+//   spectator_server [port] [map.mihm]
+//
+// Each tick is encoded on a worker thread while the simulation sleeps until
+// the next one, which waits for it before touching the match again. Once a
+// second it prints how long the ticks took, that wait included, how long
+// encoding took, and how many frames are waiting for the network thread.
+
+#include "Bot.hpp"
+#include "Match.hpp"
+#include "Pipeline.hpp"
+#include "SpectatorServer.hpp"
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+
+int main(int argc, char **argv) {
+  uint16_t port = argc > 1 ? static_cast<uint16_t>(std::atoi(argv[1])) : 9002;
+  const float tickRate = 30.0f;
+  const float deltaTime = 1.0f / tickRate;
+  const long maxTicks = static_cast<long>(600 * tickRate);
+
+  SpectatorServer server;
+  server.Start(port);
+  std::printf("spectators on ws://localhost:%u\n", port);
+
+  using Clock = std::chrono::steady_clock;
+  for (unsigned seed = 1;; seed++) {
+    MatchConfig config;
+    config.seed = seed;
+    config.cosmetics = false;
+    if (argc > 2) {
+      config.mapPath = argv[2];
+    }
+    Match match(config);
+    ScriptedBot bot1(Player::PLAYER1, BotProfile(), seed * 2 + 1);
+    ScriptedBot bot2(Player::PLAYER2, BotProfile(), seed * 2 + 2);
+    SpectatorEncoder encoder;
+    pipeline::WorkerPool encoding(1);
+    std::atomic<double> encodeSeconds{0.0};
+
+    auto next = Clock::now();
+    double busySeconds = 0.0, worstSeconds = 0.0;
+    long ticks = 0;
+    while (!match.GetWinner() && match.GetTick() < maxTicks) {
+      auto started = Clock::now();
+      encoding.Wait();
+      bot1.Update(match, deltaTime);
+      bot2.Update(match, deltaTime);
+      match.UpdateEntities(deltaTime);
+      encoding.Submit([&]() {
+        auto begun = Clock::now();
+        server.Publish(encoder.Encode(match));
+        encodeSeconds = encodeSeconds +
+                        std::chrono::duration<double>(Clock::now() - begun)
+                            .count();
+      });
+
+      double seconds =
+          std::chrono::duration<double>(Clock::now() - started).count();
+      busySeconds += seconds;
+      worstSeconds = std::max(worstSeconds, seconds);
+      if (++ticks == static_cast<long>(tickRate)) {
+        std::printf("tick %ld: mean %.3f ms, max %.3f ms, encode %.3f ms, "
+                    "%zu queued\n",
+                    match.GetTick(), busySeconds / ticks * 1000.0,
+                    worstSeconds * 1000.0, encodeSeconds / ticks * 1000.0,
+                    server.QueuedFrames());
+        busySeconds = worstSeconds = 0.0;
+        encodeSeconds = 0.0;
+        ticks = 0;
+      }
+
+      next += std::chrono::duration_cast<Clock::duration>(
+          std::chrono::duration<float>(deltaTime));
+      std::this_thread::sleep_until(next);
+    }
+    encoding.Wait();
+  }
+}